@@ -1,74 +1,140 @@
 #include <vector>
 #include <algorithm>
+#include <math.h>
 #include "../Vec3.h"
 #include "../Materials/Material.h"
 #include "../Ray.h"
 #include "../BBox.h"
 #include "../Face.h"
 #include "../Intersect.h"
+#include "../QuantizedMesh.h"
 #include "KdTree.h"
 
 using namespace hiraishi;
 
-void KdTree::init(std::vector<Face>& faces) {
-    for (int i = 0; i < faces.size(); ++i) {
-        allFaces.push_back(&faces[i]);
+// 2^6 subtrees are enough to keep the threads busy, a small tree is built on one thread
+static const int parallelBuildDepth = 6;
+static const size_t minParallelBuildFaces = 1 << 14;
+
+void KdTree::init(const Face* faces, const size_t numFaces) {
+    nodeBuf.clear();
+    faceIndexBuf.clear();
+    extNodes = NULL;
+    extFaceIndices = NULL;
+
+    std::vector<int> allFaces(numFaces);
+    for (size_t i = 0; i < numFaces; ++i) {
+        allFaces[i] = (int)i;
+    }
+
+    std::vector<DeferredBuild> deferred;
+    build(allFaces, faces, 0, minParallelBuildFaces <= numFaces ? &deferred : NULL);
+    if (deferred.size() == 0) return;
+
+    std::vector<KdTree> subtrees(deferred.size());
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < (int)deferred.size(); ++i) {
+        subtrees[i].build(deferred[i].faceIds, faces, deferred[i].depth, NULL);
+    }
+
+    const size_t numTopNodes = nodeBuf.size();
+    std::vector<int> roots(deferred.size());
+    for (size_t i = 0; i < subtrees.size(); ++i) {
+        roots[i] = appendSubtree(subtrees[i]);
     }
+    for (size_t i = 0; i < numTopNodes; ++i) {
+        for (int c = 0; c < 2; c++) {
+            if (nodeBuf[i].children[c] < -1) nodeBuf[i].children[c] = roots[-2 - nodeBuf[i].children[c]];
+        }
+    }
+}
 
-    rootNode = build(allFaces, 0);
+void KdTree::setExternal(const Node* nodes, const size_t numNodes, const int* faceIndices, const size_t numFaceIndices) {
+    nodeBuf.clear();
+    faceIndexBuf.clear();
+    extNodes = nodes;
+    numExtNodes = numNodes;
+    extFaceIndices = faceIndices;
+    numExtFaceIndices = numFaceIndices;
 }
 
-Node* KdTree::build(const std::vector<Face*> &_faces, int depth) {
-    Node* node = new Node();
-    node->faces = _faces;
-    node->children[0] = NULL;
-    node->children[1] = NULL;
-    node->bbox = BBox();
+void KdTree::expandBounds(const Vec3& margin) {
+    // boxes were made from the original positions, grow them so they still enclose moved vertices
+    if (extNodes) {
+        nodeBuf.assign(extNodes, extNodes + numExtNodes);
+        faceIndexBuf.assign(extFaceIndices, extFaceIndices + numExtFaceIndices);
+        extNodes = NULL;
+        extFaceIndices = NULL;
+    }
+    for (size_t i = 0; i < nodeBuf.size(); i++) {
+        nodeBuf[i].bbox.min = nodeBuf[i].bbox.min - margin;
+        nodeBuf[i].bbox.max = nodeBuf[i].bbox.max + margin;
+    }
+}
+
+int KdTree::build(const std::vector<int>& _faces, const Face* faces, int depth, std::vector<DeferredBuild>* deferred) {
+    if (deferred && depth == parallelBuildDepth && 1 < _faces.size()) {
+        DeferredBuild d;
+        d.faceIds = _faces;
+        d.depth = depth;
+        deferred->push_back(d);
+        return -1 - (int)deferred->size();
+    }
+
+    const int nodeIndex = (int)nodeBuf.size();
+    nodeBuf.push_back(Node());
+    Node node;
+    node.children[0] = -1;
+    node.children[1] = -1;
+    node.bbox = BBox();
+    node.faceOffset = (int)faceIndexBuf.size();
+    node.numFaces = 0;
 
     if (_faces.size() == 0) {
-        return node;
+        nodeBuf[nodeIndex] = node;
+        return nodeIndex;
     }
 
     if (_faces.size() == 1) {
-        node->bbox = _faces[0]->getBBox();
-        node->children[0] = new Node();
-        node->children[1] = new Node();
-        node->children[0]->faces = std::vector<Face*>();
-        node->children[1]->faces = std::vector<Face*>();
-        return node;
+        node.bbox = faces[_faces[0]].getBBox();
+        node.numFaces = 1;
+        faceIndexBuf.push_back(_faces[0]);
+        nodeBuf[nodeIndex] = node;
+        return nodeIndex;
     }
 
-    node->bbox = _faces[0]->getBBox();
+    node.bbox = faces[_faces[0]].getBBox();
     for (int i = 1; i < _faces.size(); ++i) {
-        node->bbox.grow(_faces[i]->getBBox());
+        node.bbox.grow(faces[_faces[i]].getBBox());
     }
 
     // get mid pos of all faces
     Vec3 midPos(0.0, 0.0, 0.0);
     for (int i = 0; i < _faces.size(); ++i) {
-        midPos = midPos + (_faces[i]->getMidPos() * (1.0 / _faces.size()));
+        midPos = midPos + (faces[_faces[i]].getMidPos() * (1.0 / _faces.size()));
     }
 
-    std::vector<Face*> leftFaces;
-    std::vector<Face*> rightFaces;
+    std::vector<int> leftFaces;
+    std::vector<int> rightFaces;
 
     const int axis = depth % 3;
     for (int i = 0; i < _faces.size(); ++i) {
+        const Vec3& mid = faces[_faces[i]].getMidPos();
         switch (axis) {
             case 0: // axis = x
-                if (midPos.x < _faces[i]->getMidPos().x)
+                if (midPos.x < mid.x)
                     leftFaces.push_back(_faces[i]);
                 else
                     rightFaces.push_back(_faces[i]);
                 break;
             case 1: // axis = y
-                if (midPos.y < _faces[i]->getMidPos().y)
+                if (midPos.y < mid.y)
                     leftFaces.push_back(_faces[i]);
                 else
                     rightFaces.push_back(_faces[i]);
                 break;
             case 2: // axis = z
-                if (midPos.z < _faces[i]->getMidPos().z)
+                if (midPos.z < mid.z)
                     leftFaces.push_back(_faces[i]);
                 else
                     rightFaces.push_back(_faces[i]);
@@ -76,58 +142,72 @@ Node* KdTree::build(const std::vector<Face*> &_faces, int depth) {
         }
     }
 
-    if (leftFaces.size() == 0 && 0 < rightFaces.size())
-        leftFaces = rightFaces;
-    if (rightFaces.size() == 0 && 0 < leftFaces.size())
-        rightFaces = leftFaces;
-
-    int matches = 0;
-    for (int i = 0; i < leftFaces.size(); ++i) {
-        for (int j = 0; j < rightFaces.size(); ++j) {
-            if (leftFaces[i] == rightFaces[j])
-                matches++;
-        }
-    }
-
-    if ((double)matches / leftFaces.size() < 0.5 && (double)matches / rightFaces.size() < 0.5) {
-        node->children[0] = build(leftFaces, depth + 1);
-        node->children[1] = build(rightFaces, depth + 1);
+    // the sides never share a face, so the split failed only if one side is empty
+    if (0 < leftFaces.size() && 0 < rightFaces.size()) {
+        nodeBuf[nodeIndex] = node;
+        const int left = build(leftFaces, faces, depth + 1, deferred);
+        const int right = build(rightFaces, faces, depth + 1, deferred);
+        nodeBuf[nodeIndex].children[0] = left;
+        nodeBuf[nodeIndex].children[1] = right;
     }
     else {
-        node->children[0] = new Node();
-        node->children[1] = new Node();
-        node->children[0]->faces = std::vector<Face*>();
-        node->children[1]->faces = std::vector<Face*>();
+        // leaf
+        node.numFaces = (int)_faces.size();
+        faceIndexBuf.insert(faceIndexBuf.end(), _faces.begin(), _faces.end());
+        nodeBuf[nodeIndex] = node;
     }
 
-    return node;
+    return nodeIndex;
+}
+
+int KdTree::appendSubtree(const KdTree& subtree) {
+    const int nodeOffset = (int)nodeBuf.size();
+    const int indexOffset = (int)faceIndexBuf.size();
+    const Node* nodes = subtree.getNodes();
+    for (size_t i = 0; i < subtree.getNumNodes(); ++i) {
+        Node node = nodes[i];
+        if (node.children[0] != -1) {
+            node.children[0] += nodeOffset;
+            node.children[1] += nodeOffset;
+        }
+        else {
+            node.faceOffset += indexOffset;
+        }
+        nodeBuf.push_back(node);
+    }
+    const int* faceIndices = subtree.getFaceIndices();
+    for (size_t i = 0; i < subtree.getNumFaceIndices(); ++i) {
+        faceIndexBuf.push_back(faceIndices[i]);
+    }
+    return nodeOffset;
 }
 
-bool KdTree::intersect(Node* node, const Ray& ray, Intersect& isect, const std::vector<Vec3>& vertices) const {
+bool KdTree::intersect(const int nodeIndex, const Ray& ray, Intersect& isect, const Vec3* vertices, const Face* faces, const Material* materials) const {
     bool hit = false;
-    if (node == NULL)
-        node = rootNode;
-    if (node->bbox.intersect(ray)) {
-        if (0 < node->children[0]->faces.size() || 0 < node->children[1]->faces.size()) {
-            bool isectLeft = intersect(node->children[0], ray, isect, vertices);
-            bool isectRight = intersect(node->children[1], ray, isect, vertices);
+    const Node& node = getNodes()[nodeIndex];
+    if (node.bbox.intersect(ray)) {
+        if (node.children[0] != -1) {
+            bool isectLeft = intersect(node.children[0], ray, isect, vertices, faces, materials);
+            bool isectRight = intersect(node.children[1], ray, isect, vertices, faces, materials);
             return isectLeft || isectRight;
         }
         else {
-            Material* isectMtl;
-            for (int j = 0; j < node->faces.size(); ++j) {
+            const int* faceIndices = getFaceIndices() + node.faceOffset;
+            for (int j = 0; j < node.numFaces; ++j) {
+                const Face& face = faces[faceIndices[j]];
                 Vec3 isectPos, isectNormal;
                 double t;
                 Vec3 v[3];
                 for (int i = 0; i < 3; i++) {
-                    v[i] = vertices[node->faces[j]->getVIndex(i) - 1];
+                    v[i] = vertices[face.getVIndex(i) - 1];
                 }
-                if (!node->faces[j]->intersect(v, ray, &t, isectPos, isectNormal, &isectMtl))
+                if (!face.intersect(v, ray, &t, isectPos, isectNormal))
                     continue;
                 if (t < isect.t) {
                     hit = true;
                     isect.t = t;
-                    isect.mtlPtr = isectMtl;
+                    isect.mtlPtr = &materials[face.getMtlIndex()];
+                    isect.faceIndex = faceIndices[j];
                     isect.pos = isectPos;
                     isect.normal = isectNormal;
                 }
@@ -136,4 +216,130 @@ bool KdTree::intersect(Node* node, const Ray& ray, Intersect& isect, const std::
         }
     }
     return false;
+}
+
+void KdTree::initFloat(const Vec3* vertices, const Face* faces) {
+    const Node* nodes = getNodes();
+    const int* faceIndices = getFaceIndices();
+    nodeBufF.resize(getNumNodes());
+    faceBufF.resize(getNumFaceIndices());
+    for (size_t i = 0; i < getNumNodes(); ++i) {
+        const Node& node = nodes[i];
+        NodeF& nodeF = nodeBufF[i];
+        const double bmin[3] = { node.bbox.min.x, node.bbox.min.y, node.bbox.min.z };
+        const double bmax[3] = { node.bbox.max.x, node.bbox.max.y, node.bbox.max.z };
+        for (int a = 0; a < 3; a++) {
+            nodeF.bmin[a] = nextafterf((float)bmin[a], -HUGE_VALF);
+            nodeF.bmax[a] = nextafterf((float)bmax[a], HUGE_VALF);
+        }
+        nodeF.children[0] = node.children[0];
+        nodeF.children[1] = node.children[1];
+        nodeF.faceOffset = node.faceOffset;
+        nodeF.numFaces = node.numFaces;
+    }
+    for (size_t i = 0; i < getNumFaceIndices(); ++i) {
+        const Face& face = faces[faceIndices[i]];
+        const Vec3& p0 = vertices[face.getVIndex(0) - 1];
+        const Vec3& p1 = vertices[face.getVIndex(1) - 1];
+        const Vec3& p2 = vertices[face.getVIndex(2) - 1];
+        FaceF& faceF = faceBufF[i];
+        faceF.v0 = Vec3f(p0);
+        faceF.e1 = Vec3f(p1 - p0);
+        faceF.e2 = Vec3f(p2 - p0);
+        faceF.normal = Vec3f(face.getNormal());
+        faceF.faceIndex = faceIndices[i];
+        faceF.isTwoSided = face.getIsTwoSided() ? 1 : 0;
+    }
+}
+
+bool KdTree::intersectQuantized(const int nodeIndex, const Ray& ray, Intersect& isect, const QuantizedMesh& mesh, const Material* materials) const {
+    const Node& node = getNodes()[nodeIndex];
+    if (!node.bbox.intersect(ray)) return false;
+    if (node.children[0] != -1) {
+        const bool isectLeft = intersectQuantized(node.children[0], ray, isect, mesh, materials);
+        const bool isectRight = intersectQuantized(node.children[1], ray, isect, mesh, materials);
+        return isectLeft || isectRight;
+    }
+
+    bool hit = false;
+    const int* faceIndices = getFaceIndices() + node.faceOffset;
+    for (int j = 0; j < node.numFaces; ++j) {
+        Vec3 isectPos, isectNormal;
+        double t;
+        if (!mesh.intersect(faceIndices[j], ray, &t, isectPos, isectNormal))
+            continue;
+        if (t < isect.t) {
+            hit = true;
+            isect.t = t;
+            isect.mtlPtr = &materials[mesh.getFaceMtlIndex(faceIndices[j])];
+            isect.faceIndex = faceIndices[j];
+            isect.pos = isectPos;
+            isect.normal = isectNormal;
+        }
+    }
+    return hit;
+}
+
+bool NodeF::intersect(const RayF& ray) const {
+    float tmin = (bmin[0] - ray.o.x) * ray.invD.x;
+    float tmax = (bmax[0] - ray.o.x) * ray.invD.x;
+    if (tmin > tmax) std::swap(tmin, tmax);
+    float tymin = (bmin[1] - ray.o.y) * ray.invD.y;
+    float tymax = (bmax[1] - ray.o.y) * ray.invD.y;
+    if (tymin > tymax) std::swap(tymin, tymax);
+    if ((tmin > tymax) || (tymin > tmax)) return false;
+    if (tymin > tmin) tmin = tymin;
+    if (tymax < tmax) tmax = tymax;
+    float tzmin = (bmin[2] - ray.o.z) * ray.invD.z;
+    float tzmax = (bmax[2] - ray.o.z) * ray.invD.z;
+    if (tzmin > tzmax) std::swap(tzmin, tzmax);
+    if ((tmin > tzmax) || (tzmin > tmax)) return false;
+    return true;
+}
+
+bool FaceF::intersect(const RayF& ray, float* tParam) const {
+    // Moller-Trumbore, same as Face::intersect
+    if (!isTwoSided) {
+        if (Vec3f::dot(normal, -ray.d) < (float)H_EPSILON) return false;
+    }
+    const Vec3f alpha = Vec3f::cross(ray.d, e2);
+    const float det = Vec3f::dot(e1, alpha);
+    if (-(float)H_EPSILON < det && det < (float)H_EPSILON) return false;
+
+    const float invDet = 1.0f / det;
+    const Vec3f r = ray.o - v0;
+    const float u = Vec3f::dot(alpha, r) * invDet;
+    if (u < 0.0f || 1.0f < u) return false;
+
+    const Vec3f beta = Vec3f::cross(r, e1);
+    const float v = Vec3f::dot(ray.d, beta) * invDet;
+    if (v < 0.0f || 1.0f < u + v) return false;
+
+    const float t = Vec3f::dot(e2, beta) * invDet;
+    if (t < ray.tMin) return false;
+
+    *tParam = t;
+    return true;
+}
+
+bool KdTree::intersectFloat(const int nodeIndex, const RayF& ray, float& t, int& faceIndex) const {
+    const NodeF& node = nodeBufF[nodeIndex];
+    if (!node.intersect(ray)) return false;
+    if (node.children[0] != -1) {
+        bool isectLeft = intersectFloat(node.children[0], ray, t, faceIndex);
+        bool isectRight = intersectFloat(node.children[1], ray, t, faceIndex);
+        return isectLeft || isectRight;
+    }
+    bool hit = false;
+    const FaceF* leafFaces = faceBufF.data() + node.faceOffset;
+    for (int j = 0; j < node.numFaces; ++j) {
+        float ft;
+        if (!leafFaces[j].intersect(ray, &ft)) continue;
+        if (ft < t) {
+            hit = true;
+            t = ft;
+            faceIndex = leafFaces[j].faceIndex;
+        }
+    }
+    return hit;
 }
\ No newline at end of file
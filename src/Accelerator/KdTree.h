@@ -1,21 +1,87 @@
 #pragma once
 
 namespace hiraishi {
+    class QuantizedMesh;
+
+    // flattened node, children and faces are referred by index so the tree can live in a SceneFile
     struct Node {
-        Node* children[2];
         BBox bbox;
-        std::vector<Face*> faces;
+        int children[2];   // -1 if leaf
+        int faceOffset;    // first index in faceIndices (leaf only)
+        int numFaces;
+    };
+
+    // single precision copies for the float traversal path
+    struct RayF {
+        Vec3f o;
+        Vec3f d;
+        Vec3f invD;
+        float tMin;
+    };
+
+    struct NodeF {
+        float bmin[3]; // rounded outward so the box still encloses its faces
+        float bmax[3];
+        int children[2];
+        int faceOffset;
+        int numFaces;
+
+        bool intersect(const RayF& ray) const;
+    };
+
+    struct FaceF {
+        Vec3f v0;
+        Vec3f e1;
+        Vec3f e2;
+        Vec3f normal;
+        int faceIndex;
+        int isTwoSided;
+
+        bool intersect(const RayF& ray, float* t) const;
     };
 
     class KdTree {
     private:
-        std::vector<Face*> allFaces;
+        std::vector<Node> nodeBuf;
+        std::vector<int> faceIndexBuf;
+        // external storage (mapped SceneFile), used instead of the buffers if not NULL
+        const Node* extNodes = NULL;
+        const int* extFaceIndices = NULL;
+        size_t numExtNodes = 0;
+        size_t numExtFaceIndices = 0;
+        // float traversal data, faces are stored in leaf order so a leaf reads one contiguous range
+        std::vector<NodeF> nodeBufF;
+        std::vector<FaceF> faceBufF;
+
+        // faces of a subtree that build() leaves to be built on another thread
+        struct DeferredBuild {
+            std::vector<int> faceIds;
+            int depth;
+        };
+
+        // with deferred, subtrees at parallelBuildDepth are not built but queued, and the child
+        // index referring to one is -2 - its index in deferred until init() appends it
+        int build(const std::vector<int>& faceIds, const Face* faces, int depth, std::vector<DeferredBuild>* deferred);
+        int appendSubtree(const KdTree& subtree);
 
     public:
-        Node* rootNode;
+        // the top levels are split on this thread and the subtrees below them on all threads,
+        // the tree is the same as one build over all faces
+        void init(const Face* faces, const size_t numFaces);
+        void setExternal(const Node* nodes, const size_t numNodes, const int* faceIndices, const size_t numFaceIndices);
+        void expandBounds(const Vec3& margin);
+
+        const Node* getNodes() const { return extNodes ? extNodes : nodeBuf.data(); }
+        size_t getNumNodes() const { return extNodes ? numExtNodes : nodeBuf.size(); }
+        const int* getFaceIndices() const { return extNodes ? extFaceIndices : faceIndexBuf.data(); }
+        size_t getNumFaceIndices() const { return extNodes ? numExtFaceIndices : faceIndexBuf.size(); }
+
+        void initFloat(const Vec3* vertices, const Face* faces);
+        bool hasFloat() const { return 0 < nodeBufF.size(); }
+        size_t getFloatBytes() const { return nodeBufF.size() * sizeof(NodeF) + faceBufF.size() * sizeof(FaceF); }
 
-        void init(std::vector<Face>& faces);
-        Node* build(const std::vector<Face*> &_faces, int depth);
-        bool intersect(Node* node, const Ray& ray, Intersect& isect, const std::vector<Vec3>& vertices) const;
+        bool intersect(const int nodeIndex, const Ray& ray, Intersect& isect, const Vec3* vertices, const Face* faces, const Material* materials) const;
+        bool intersectQuantized(const int nodeIndex, const Ray& ray, Intersect& isect, const QuantizedMesh& mesh, const Material* materials) const;
+        bool intersectFloat(const int nodeIndex, const RayF& ray, float& t, int& faceIndex) const;
     };
 }
\ No newline at end of file
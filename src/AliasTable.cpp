@@ -0,0 +1,48 @@
+#include "AliasTable.h"
+
+using namespace hiraishi;
+
+void AliasTable::init(const std::vector<double>& weights) {
+    const int n = (int)weights.size();
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) sum += weights[i];
+
+    probs.assign(n, 0.0);
+    thresholds.assign(n, 1.0);
+    aliases.resize(n);
+    if (n == 0 || !(0.0 < sum)) return;
+
+    // Vose's method: fill the bins below the average with the ones above it
+    std::vector<double> scaled(n);
+    std::vector<int> small, large;
+    for (int i = 0; i < n; i++) {
+        probs[i] = weights[i] / sum;
+        scaled[i] = probs[i] * n;
+        aliases[i] = i;
+        if (scaled[i] < 1.0) small.push_back(i);
+        else large.push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+        const int s = small.back();
+        const int l = large.back();
+        small.pop_back();
+        thresholds[s] = scaled[s];
+        aliases[s] = l;
+        scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+        if (scaled[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // what is left is 1 up to rounding
+    for (size_t k = 0; k < small.size(); k++) thresholds[small[k]] = 1.0;
+    for (size_t k = 0; k < large.size(); k++) thresholds[large[k]] = 1.0;
+}
+
+int AliasTable::sample(const double u) const {
+    const int n = (int)probs.size();
+    const double scaled = u * n;
+    int i = (int)scaled;
+    if (n <= i) i = n - 1;
+    return scaled - i < thresholds[i] ? i : aliases[i];
+}
\ No newline at end of file
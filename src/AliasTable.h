@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+namespace hiraishi {
+    // Walker's alias method, picks index i with probability weights[i] / sum of weights in O(1)
+    class AliasTable {
+    private:
+        std::vector<double> probs;
+        std::vector<double> thresholds; // keep the bin below this, otherwise take its alias
+        std::vector<int> aliases;
+
+    public:
+        void init(const std::vector<double>& weights);
+
+        size_t size() const { return probs.size(); }
+        double getProb(const int i) const { return probs[i]; }
+        int sample(const double u) const;
+    };
+}
\ No newline at end of file
@@ -17,7 +17,7 @@ namespace hiraishi {
                        fmax(max.z, bbox.max.z));
         }
 
-        bool intersect(const Ray& ray) {
+        bool intersect(const Ray& ray) const {
             double tmin = (min.x - ray.o.x) / ray.d.x;
             double tmax = (max.x - ray.o.x) / ray.d.x;
 
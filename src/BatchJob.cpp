@@ -0,0 +1,141 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdio.h>
+#include <direct.h>
+#include <sys/stat.h>
+#include "Random.h"
+#include "Vec3.h"
+#include "Sampler.h"
+#include "Camera.h"
+#include "Film.h"
+#include "BatchJob.h"
+
+using namespace hiraishi;
+
+std::vector<std::string> getWords(char *str);
+
+bool BatchJob::initFrames(const Camera& camera) {
+    frames.clear();
+    if (0 < numTurntableFrames) {
+        setTurntable(camera, numTurntableFrames);
+    }
+    else if (!camerasPath.empty() && readCameras(camerasPath.c_str()) && 0 < numPathFrames) {
+        interpolate(numPathFrames);
+    }
+    if (frames.empty()) std::cout << ">> Batch : No cameras, set Batch.turntable or Batch.cameras" << std::endl;
+    return !frames.empty();
+}
+
+bool BatchJob::readCameras(const char* filename) {
+    FILE* fp;
+    if (fopen_s(&fp, filename, "r") != 0 || fp == NULL) {
+        std::cout << ">> Batch : Can not open " << filename << std::endl;
+        return false;
+    }
+
+    frames.clear();
+    Frame frame;
+    while (1) {
+        char str[256];
+        if (fgets(str, 256, fp) == NULL) break;
+        std::vector<std::string> words = getWords(str);
+        if (words.size() == 0 || words[0] == "#") continue;
+        if (words[0] == "Camera.eye") {
+            frame.eye = Vec3(atof(words[1].c_str()), atof(words[2].c_str()), atof(words[3].c_str()));
+            frames.push_back(frame);
+        }
+        if (frames.empty()) continue;
+        if (words[0] == "Camera.center") frames.back().center = Vec3(atof(words[1].c_str()), atof(words[2].c_str()), atof(words[3].c_str()));
+        if (words[0] == "Camera.fov") frames.back().fovDeg = atof(words[1].c_str());
+        frame = frames.back();
+    }
+
+    fclose(fp);
+    return !frames.empty();
+}
+
+static Vec3 catmullRom(const Vec3& p0, const Vec3& p1, const Vec3& p2, const Vec3& p3, const double t) {
+    const double t2 = t * t;
+    const double t3 = t2 * t;
+    return (p1 * 2.0 + (p2 - p0) * t + (p0 * 2.0 - p1 * 5.0 + p2 * 4.0 - p3) * t2 + (p1 * 3.0 - p0 - p2 * 3.0 + p3) * t3) * 0.5;
+}
+
+void BatchJob::interpolate(const int numFrames) {
+    if (frames.empty() || numFrames <= 0) return;
+    // the keys at the ends are repeated for the tangents there
+    const std::vector<Frame> keys = frames;
+    const int last = (int)keys.size() - 1;
+    frames.resize(numFrames);
+    for (int k = 0; k < numFrames; k++) {
+        const double s = (1 < numFrames) ? (double)k * last / (numFrames - 1) : 0.0;
+        const int i = (last <= (int)s) ? (last == 0 ? 0 : last - 1) : (int)s;
+        const double t = s - i;
+        const Frame& k0 = keys[0 < i ? i - 1 : 0];
+        const Frame& k1 = keys[i];
+        const Frame& k2 = keys[i < last ? i + 1 : last];
+        const Frame& k3 = keys[i + 1 < last ? i + 2 : last];
+        frames[k].eye = catmullRom(k0.eye, k1.eye, k2.eye, k3.eye, t);
+        frames[k].center = catmullRom(k0.center, k1.center, k2.center, k3.center, t);
+        frames[k].fovDeg = catmullRom(Vec3(k0.fovDeg, 0.0, 0.0), Vec3(k1.fovDeg, 0.0, 0.0), Vec3(k2.fovDeg, 0.0, 0.0), Vec3(k3.fovDeg, 0.0, 0.0), t).x;
+    }
+}
+
+void BatchJob::setTurntable(const Camera& camera, const int numFrames) {
+    frames.clear();
+    const Vec3& center = camera.getCenter();
+    const Vec3 d = camera.getEye() - center;
+    for (int k = 0; k < numFrames; k++) {
+        const double phi = 2.0 * M_PI * k / numFrames;
+        Frame frame;
+        frame.eye = center + Vec3(d.x * cos(phi) + d.z * sin(phi), d.y, -d.x * sin(phi) + d.z * cos(phi));
+        frame.center = center;
+        frame.fovDeg = camera.getFov() * 180.0 / M_PI;
+        frames.push_back(frame);
+    }
+}
+
+void BatchJob::writeFrame(const Film* film, const int frame) {
+    // the film is cleared for the next frame right away, the writer keeps a copy
+    finishWrite();
+    const int width = film->width;
+    const int height = film->height;
+    writtenPixels.assign(film->getPixels(), film->getPixels() + film->getNumPixels() * 3);
+    char fileName[64];
+    sprintf_s(fileName, "results/frame%04d.ppm", frame);
+    const std::string name(fileName);
+    writer = std::thread([this, name, width, height]() {
+        Film::writeImage(name, writtenPixels.data(), width, height);
+    });
+}
+
+void BatchJob::finishWrite() {
+    if (writer.joinable()) writer.join();
+}
+
+void BatchJob::render(Camera* camera, Film* film, const std::function<void()>& renderFrame) {
+    struct stat statBuf;
+    if (stat("results", &statBuf) == -1) _mkdir("results");
+
+    const auto start = std::chrono::system_clock::now();
+    const int numFrames = getNumFrames();
+    int numWritten = 0;
+    for (int k = 0; k < numFrames && !isStopRequested; k++) {
+        std::cout << ">> Batch : Frame " << k + 1 << " / " << numFrames << std::endl;
+        camera->setEye(frames[k].eye);
+        camera->setCenter(frames[k].center);
+        camera->setFovDeg(frames[k].fovDeg);
+        camera->init(film->width, film->height);
+        film->clearAccumulation();
+        renderFrame();
+        if (isStopRequested) break;
+        writeFrame(film, k);
+        numWritten++;
+    }
+    finishWrite();
+
+    const auto msec = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start).count();
+    std::cout << ">> Batch : " << numWritten << " of " << numFrames << " frames written to results" << std::endl
+        << ">> Batch : Time " << msec << "msec" << std::endl << std::endl;
+}
\ No newline at end of file
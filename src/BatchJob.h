@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+namespace hiraishi {
+    class Camera;
+    class Film;
+
+    // Frames of one scene rendered in a row, so the scene and its kd-tree are loaded once.
+    // The cameras are listed in a file, sampled along a path through the listed ones, or turn
+    // around the center of the camera. A frame is written on its own thread while the next renders.
+    class BatchJob {
+    public:
+        struct Frame {
+            Vec3 eye;
+            Vec3 center;
+            double fovDeg = 30.0;
+        };
+
+    private:
+        std::vector<Frame> frames;
+        std::atomic<bool> isStopRequested;
+        std::thread writer;
+        std::vector<unsigned char> writtenPixels; // copy of the film of the frame being written
+
+        void writeFrame(const Film* film, const int frame);
+        void finishWrite();
+
+    public:
+        BatchJob() : isStopRequested(false) {}
+        ~BatchJob() { finishWrite(); }
+
+        std::string camerasPath;    // file of the cameras, empty : none
+        int numPathFrames = 0;      // frames along the path through the cameras, 0 : one per camera
+        int numTurntableFrames = 0; // frames around the current camera instead, 0 : none
+
+        // frames from the settings above, false if there are none
+        bool initFrames(const Camera& camera);
+        // in the syntax of the preferences, a Camera.eye line starts the next camera and the
+        // center and the fov carry over from the camera before, false if the file is not there
+        bool readCameras(const char* filename);
+        // numFrames cameras along a Catmull-Rom spline through the ones read, an animation path
+        void interpolate(const int numFrames);
+        // numFrames cameras on the circle about the vertical through the center of camera
+        void setTurntable(const Camera& camera, const int numFrames);
+        int getNumFrames() const { return (int)frames.size(); }
+
+        // renderFrame renders the film for the camera set to each frame in turn, the frames
+        // are written as results/frameNNNN.ppm, a stopped frame is not
+        void render(Camera* camera, Film* film, const std::function<void()>& renderFrame);
+        // as Renderer::stop, resetStop comes before the thread that renders the batch starts
+        void stop() { isStopRequested = true; }
+        void resetStop() { isStopRequested = false; }
+    };
+}
\ No newline at end of file
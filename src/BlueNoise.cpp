@@ -0,0 +1,131 @@
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include "Random.h"
+#include "BlueNoise.h"
+
+using namespace hiraishi;
+
+static const int N = BlueNoise::SIZE * BlueNoise::SIZE;
+static const double SIGMA = 1.5;
+
+// sums of a Gaussian around the set texels, with wrap around
+class EnergyMap {
+private:
+    std::vector<double> kernel; // by toroidal offset
+    std::vector<double> energy;
+
+public:
+    std::vector<char> isSet;
+
+    EnergyMap() : kernel(N), energy(N, 0.0), isSet(N, 0) {
+        for (int y = 0; y < BlueNoise::SIZE; y++) {
+            for (int x = 0; x < BlueNoise::SIZE; x++) {
+                const int dx = (x <= BlueNoise::SIZE / 2) ? x : BlueNoise::SIZE - x;
+                const int dy = (y <= BlueNoise::SIZE / 2) ? y : BlueNoise::SIZE - y;
+                kernel[y * BlueNoise::SIZE + x] = exp(-(dx * dx + dy * dy) / (2.0 * SIGMA * SIGMA));
+            }
+        }
+    }
+
+    void toggle(const int p) {
+        isSet[p] = !isSet[p];
+        const double sign = isSet[p] ? 1.0 : -1.0;
+        const int px = p % BlueNoise::SIZE, py = p / BlueNoise::SIZE;
+        for (int y = 0; y < BlueNoise::SIZE; y++) {
+            const int ky = ((y - py) & (BlueNoise::SIZE - 1)) * BlueNoise::SIZE;
+            for (int x = 0; x < BlueNoise::SIZE; x++) {
+                energy[y * BlueNoise::SIZE + x] += sign * kernel[ky + ((x - px) & (BlueNoise::SIZE - 1))];
+            }
+        }
+    }
+
+    // set texel with the most set texels around
+    int findTightestCluster() const {
+        int answer = -1;
+        for (int p = 0; p < N; p++) {
+            if (isSet[p] && (answer < 0 || energy[answer] < energy[p])) answer = p;
+        }
+        return answer;
+    }
+
+    // empty texel with the fewest set texels around
+    int findLargestVoid() const {
+        int answer = -1;
+        for (int p = 0; p < N; p++) {
+            if (!isSet[p] && (answer < 0 || energy[p] < energy[answer])) answer = p;
+        }
+        return answer;
+    }
+};
+
+// cell of the SIZE x SIZE square at distance d along the Hilbert curve
+static void getHilbertCell(int d, int& x, int& y) {
+    x = y = 0;
+    for (int s = 1; s < BlueNoise::SIZE; s *= 2) {
+        const int rx = 1 & (d / 2);
+        const int ry = 1 & (d ^ rx);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+        x += s * rx;
+        y += s * ry;
+        d /= 4;
+    }
+}
+
+static std::vector<float> buildTile() {
+    // initial pattern : a tenth of the texels at random, spread until moving the tightest
+    // cluster lands it in the same place
+    EnergyMap initial;
+    Random rng(0xB1E);
+    const int numInitial = N / 10;
+    for (int n = 0; n < numInitial; ) {
+        const int p = rng.intNext(0, N - 1);
+        if (initial.isSet[p]) continue;
+        initial.toggle(p);
+        n++;
+    }
+    while (true) {
+        const int cluster = initial.findTightestCluster();
+        initial.toggle(cluster);
+        const int hole = initial.findLargestVoid();
+        initial.toggle(hole);
+        if (hole == cluster) break;
+    }
+
+    std::vector<int> ranks(N);
+    // ranks below the initial pattern : remove tightest clusters
+    EnergyMap map = initial;
+    for (int rank = numInitial - 1; 0 <= rank; rank--) {
+        const int p = map.findTightestCluster();
+        map.toggle(p);
+        ranks[p] = rank;
+    }
+    // ranks above it : fill largest voids, past half this is the tightest cluster of the empty texels
+    map = initial;
+    for (int rank = numInitial; rank < N; rank++) {
+        const int p = map.findLargestVoid();
+        map.toggle(p);
+        ranks[p] = rank;
+    }
+
+    // ranks that are far apart land far apart on the curve
+    std::vector<float> offsets(N * 2);
+    for (int p = 0; p < N; p++) {
+        int x, y;
+        getHilbertCell(ranks[p], x, y);
+        offsets[p * 2] = (float)((x + 0.5) / BlueNoise::SIZE);
+        offsets[p * 2 + 1] = (float)((y + 0.5) / BlueNoise::SIZE);
+    }
+    return offsets;
+}
+
+const float* BlueNoise::getTile() {
+    static const std::vector<float> tile = buildTile();
+    return tile.data();
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#pragma once
+
+namespace hiraishi {
+    // Tileable blue noise for rotating 2D samples. The ranks of a void and cluster pattern
+    // [Ulichney 1993] are spread over the square along a Hilbert curve, so neighbouring texels
+    // hold offsets far apart in both dimensions and pixels that rotate a shared sequence by
+    // them get errors without low frequencies.
+    class BlueNoise {
+    public:
+        static const int SIZE = 64;
+
+        // SIZE x SIZE texels of 2D offsets in [0, 1), built on the first call
+        static const float* getTile();
+    };
+}
\ No newline at end of file
@@ -1,3 +1,4 @@
+#include "Random.h"
 #include "Vec3.h"
 #include "Sampler.h"
 #include "Camera.h"
@@ -12,14 +13,57 @@ void Camera::init(const int width, const int height) {
 }
 
 Vec3 Camera::samplePixel(const int i, const int j, const int width, const int height, Random& rng, Sampler& sampler) const {
+    // Sobol and blue noise streams keep the position in their first two dimensions
+    Vec3 rp;
+    if (rng.isSobol || rng.blueNoise) {
+        // x then y, as arguments they would be drawn in whatever order the compiler picks
+        rp.x = rng.next();
+        rp.y = rng.next();
+        rp.z = 0.0;
+    }
+    else {
+        rp = sampler.R2Sampler();
+    }
+    const double x = ((double)i + rp.x) / width;
+    const double y = ((double)j + rp.y) / height;
+    return getScreenPoint(x, y);
+}
+
+Vec3 Camera::getScreenPoint(const double x, const double y) const {
     const double halfH = std::tan(fov * 0.5);
     const double halfW = aspect * halfH;
     const Vec3 screen_u = u * halfW * 2.0;
     const Vec3 screen_v = v * halfH * 2.0;
     const Vec3 screen_w = eye - u * halfW - v * halfH - w;
-    const Vec3 rp = sampler.R2Sampler();
-    const double x = ((double)i + rp.x) / width;
-    const double y = ((double)j + rp.y) / height;
     const Vec3 target = screen_w + screen_u * x + screen_v * y;
     return target;
+}
+bool Camera::getPixel(const Vec3& dir, const int width, const int height, int& i, int& j) const {
+    const double cosTheta = -Vec3::dot(dir, w);
+    if (cosTheta <= 0.0) return false;
+    const double halfH = std::tan(fov * 0.5);
+    const double halfW = aspect * halfH;
+    // where dir crosses the screen at distance 1, as x and y of samplePixel
+    const double x = (Vec3::dot(dir, u) / cosTheta + halfW) / (2.0 * halfW);
+    const double y = (Vec3::dot(dir, v) / cosTheta + halfH) / (2.0 * halfH);
+    if (x < 0.0 || 1.0 <= x || y < 0.0 || 1.0 <= y) return false;
+    i = (int)(x * width);
+    j = (int)(y * height);
+    return i < width && j < height;
+}
+
+double Camera::getImportance(const Vec3& dir) const {
+    const double cosTheta = -Vec3::dot(dir, w);
+    if (cosTheta <= 0.0) return 0.0;
+    const double halfH = std::tan(fov * 0.5);
+    const double area = 4.0 * aspect * halfH * halfH;
+    return 1.0 / (area * cosTheta * cosTheta * cosTheta * cosTheta);
+}
+
+double Camera::getDirectionPdf(const Vec3& dir) const {
+    const double cosTheta = -Vec3::dot(dir, w);
+    if (cosTheta <= 0.0) return 0.0;
+    const double halfH = std::tan(fov * 0.5);
+    const double area = 4.0 * aspect * halfH * halfH;
+    return 1.0 / (area * cosTheta * cosTheta * cosTheta);
 }
\ No newline at end of file
@@ -31,5 +31,13 @@ namespace hiraishi {
 
         void init(const int width, const int height);
         Vec3 samplePixel(const int i, const int j, const int width, const int height, Random& rng, Sampler& sampler) const;
+        // point of the screen at x and y of the film, both in [0, 1)
+        Vec3 getScreenPoint(const double x, const double y) const;
+        // pixel a ray leaving the eye along dir passes through, false if it misses the film
+        bool getPixel(const Vec3& dir, const int width, const int height, int& i, int& j) const;
+        // importance We of a ray along dir, normalised over the whole film, and the solid angle pdf
+        // of samplePixel for it with the pixel picked uniformly
+        double getImportance(const Vec3& dir) const;
+        double getDirectionPdf(const Vec3& dir) const;
     };
 }
\ No newline at end of file
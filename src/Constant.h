@@ -4,4 +4,9 @@
 #define H_INFINITE 1e10
 #define H_MTL_DIFFUSE 2
 #define H_MTL_MIRROR 5
-#define H_MTL_GLASS 7
\ No newline at end of file
+#define H_MTL_GLASS 7
+#define H_MTL_VOLUME 11
+// light sampling of Renderer_Integrator
+#define H_LIGHT_BSDF 0 // emission is found by BSDF sampling only
+#define H_LIGHT_NEE 1  // the light is sampled at non-delta vertices, emission is added after delta ones
+#define H_LIGHT_MIS 2  // both, weighted by the power heuristic
\ No newline at end of file
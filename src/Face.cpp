@@ -10,14 +10,12 @@
 using namespace hiraishi;
 
 Face::Face(const std::vector<int>& vi) {
-    vIndices.clear();
     for (std::vector<int>::const_iterator i = vi.begin(); i != vi.end(); i++) {
-        vIndices.push_back(*i);
+        appendVIndex(*i);
     }
 }
 
 void Face::makeEquation(const Vec3& p0, const Vec3& p1, const Vec3& p2) {
-    pos = p0;
     Vec3 answer = Vec3::cross(p1 - p0, p2 - p0);
     normal = answer.normalize();
     midPos = (p0 + p1 + p2) / 3.0;
@@ -29,12 +27,12 @@ void Face::makeEquation(const Vec3& p0, const Vec3& p1, const Vec3& p2) {
                     fmax(fmax(p0.z, p1.z), p2.z));
 }
 
-bool Face::intersect(const Vec3* vert, const Ray& ray, double* tParam, Vec3& isectPos, Vec3& isectNormal, Material** mtlPtr) const {
+bool Face::intersect(const Vec3* vert, const Ray& ray, double* tParam, Vec3& isectPos, Vec3& isectNormal) const {
     const Vec3 o = ray.o;
     const Vec3 d = ray.d;
     const Vec3 n = getNormal();
     //߂ĂȂꍇ̂ݗ̌e
-    if (this->mtlPtr->illum != 7 && this->mtlPtr->illum != 10 && this->mtlPtr->illum != 11) {
+    if (!isTwoSided) {
         const double dot = Vec3::dot(n, -d);
         if (dot < H_EPSILON) return false;
     }
@@ -60,14 +58,13 @@ bool Face::intersect(const Vec3* vert, const Ray& ray, double* tParam, Vec3& ise
     *tParam = t;
     isectPos = o + d * t;
     isectNormal = n;
-    *mtlPtr = this->mtlPtr;
     return true;
 }
 
 void Face::print() const {
     printf("f");
-    for (std::vector<long>::const_iterator v = vIndices.begin(); v != vIndices.end(); v++) {
-        printf(" %d", *v);
+    for (int i = 0; i < numVIndices; i++) {
+        printf(" %ld", vIndices[i]);
     }
     printf("\n");
 }
\ No newline at end of file
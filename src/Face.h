@@ -1,17 +1,22 @@
 #pragma once
 
+#include <assert.h>
+
 namespace hiraishi {
     class Face {
     private:
-        std::vector<long> vIndices;
-        std::vector<long> vnIndices;
-        std::vector<long> vtIndices;
+        // fixed size and pointer free so that faces can be used in place from a SceneFile
+        long vIndices[3];
+        long vnIndices[3];
+        long vtIndices[3];
+        int numVIndices = 0;
+        int numVnIndices = 0;
+        int numVtIndices = 0;
+        int mtlIndex = -1;
+        bool isTwoSided = false;
         Vec3 normal;
-        Vec3 pos;
         Vec3 midPos;
         BBox bbox;
-        double r, g, b;
-        Material *mtlPtr;
 
     public:
         Face() {}
@@ -19,48 +24,40 @@ namespace hiraishi {
         ~Face() {}
 
         void makeEquation(const Vec3& p0, const Vec3& p1, const Vec3& p2);
+        // a face holds a triangle, polygons are triangulated before their indices are appended
         void appendVIndex(long v) {
-            vIndices.push_back(v);
+            assert(numVIndices < 3);
+            if (numVIndices < 3) vIndices[numVIndices++] = v;
         }
         void appendVnIndex(long vn) {
-            vnIndices.push_back(vn);
+            assert(numVnIndices < 3);
+            if (numVnIndices < 3) vnIndices[numVnIndices++] = vn;
         }
         void appendVtIndex(long vt) {
-            vtIndices.push_back(vt);
+            assert(numVtIndices < 3);
+            if (numVtIndices < 3) vtIndices[numVtIndices++] = vt;
+        }
+        void setVIndex(const int i, long v) {
+            vIndices[i] = v;
         }
         void clearVIndices() {
-            vIndices.clear();
+            numVIndices = 0;
         }
-        void setColor() {
-            r = (double)rand() / (double)RAND_MAX;
-            g = (double)rand() / (double)RAND_MAX;
-            b = (double)rand() / (double)RAND_MAX;
+        void setMtl(const int index, const Material& m) {
+            mtlIndex = index;
+            // only transparent faces can be hit from behind
+            isTwoSided = m.illum == 7 || m.illum == 10 || m.illum == 11;
         }
-        void setMtlPtr(Material *m) { mtlPtr = m; }
 
-        const size_t getNumVertices() const { return vIndices.size(); }
-        const Vec3& getPos() const { return pos; }
+        size_t getNumVertices() const { return numVIndices; }
         const Vec3& getMidPos() const { return midPos; }
         const BBox& getBBox() const { return bbox; }
         const Vec3& getNormal() const { return normal; }
         const long& getVIndex(const long i) const { return vIndices[i]; }
-        const std::vector<long>& getVIndices() const { return vIndices; }
-        const Material* getMtlPtr() const { return mtlPtr; }
-        const double& getR() const { return r; }
-        const double& getG() const { return g; }
-        const double& getB() const { return b; }
-
-        Face& operator=(const Face& f) {
-            vIndices = f.vIndices;
-            normal = f.normal;
-            pos = f.pos;
-            r = f.r;
-            g = f.g;
-            b = f.b;
-            return *this;
-        }
+        const int& getMtlIndex() const { return mtlIndex; }
+        bool getIsTwoSided() const { return isTwoSided; }
 
-        bool intersect(const Vec3* v, const Ray& ray, double* t, Vec3& isectPos, Vec3& isectNormal, Material** mtlPtr) const;
+        bool intersect(const Vec3* v, const Ray& ray, double* t, Vec3& isectPos, Vec3& isectNormal) const;
         void print() const;
     };
 }
\ No newline at end of file
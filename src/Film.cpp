@@ -17,6 +17,22 @@ void Film::init() {
         pixels[i * 3 + 1] = 170;
         pixels[i * 3 + 2] = 170;
     }
+    clearAccumulation();
+}
+
+void Film::getCropRect(int& x0, int& y0, int& x1, int& y1) const {
+    x0 = cropX < 0 ? 0 : (width < cropX ? width : cropX);
+    x1 = (0 < cropWidth && x0 + cropWidth < width) ? x0 + cropWidth : width;
+    // the rows of the film go up from the bottom of the image
+    const int top = cropY < 0 ? 0 : (height < cropY ? height : cropY);
+    y0 = (0 < cropHeight && top + cropHeight < height) ? height - (top + cropHeight) : 0;
+    y1 = height - top;
+}
+
+int Film::getNumCropPixels() const {
+    int x0, y0, x1, y1;
+    getCropRect(x0, y0, x1, y1);
+    return (x1 - x0) * (y1 - y0);
 }
 
 void Film::setPixelColor(const Vec3& c, int p) {
@@ -27,6 +43,83 @@ void Film::setPixelColor(const Vec3& c, int p) {
     pixels[p * 3 + 2] = (unsigned char)(fmin(255.0, pow(color.z, 1.0 / 2.2) * 255.0));
 }
 
+void Film::clearAccumulation() {
+    accumulation.assign(numPixels, Vec3());
+    sampleCounts.assign(numPixels, 0);
+    meanLuminance.assign(numPixels, 0.0);
+    m2Luminance.assign(numPixels, 0.0);
+    splats.reset(new std::atomic<double>[numPixels * 3]);
+    for (int i = 0; i < numPixels * 3; i++) {
+        splats[i] = 0.0;
+    }
+    splatScale = 0.0;
+}
+
+void Film::addSample(const Vec3& c, const int p) {
+    // a pixel is only touched by the thread rendering its tile
+    accumulation[p] = accumulation[p] + c;
+    const int n = ++sampleCounts[p];
+    // statistics of what the film can show, so lights and fireflies above 1 do not dominate
+    const double y = fmin(0.2126 * c.x + 0.7152 * c.y + 0.0722 * c.z, 1.0);
+    const double delta = y - meanLuminance[p];
+    meanLuminance[p] += delta / n;
+    m2Luminance[p] += delta * (y - meanLuminance[p]);
+}
+
+void Film::addSamples(const Vec3& sum, const int numSamples, const int p) {
+    accumulation[p] = accumulation[p] + sum;
+    sampleCounts[p] += numSamples;
+    updatePixelColor(p);
+}
+
+static void addAtomic(std::atomic<double>& a, const double value) {
+    double current = a.load(std::memory_order_relaxed);
+    while (!a.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {}
+}
+
+void Film::addSplat(const Vec3& c, const int p) {
+    addAtomic(splats[p * 3], c.x);
+    addAtomic(splats[p * 3 + 1], c.y);
+    addAtomic(splats[p * 3 + 2], c.z);
+}
+
+void Film::setSplatScale(const double scale) {
+    splatScale = scale;
+    int x0, y0, x1, y1;
+    getCropRect(x0, y0, x1, y1);
+    for (int j = y0; j < y1; j++) {
+        for (int i = x0; i < x1; i++) {
+            updatePixelColor(i + width * j);
+        }
+    }
+}
+
+int Film::getMinSampleCount() const {
+    int x0, y0, x1, y1;
+    getCropRect(x0, y0, x1, y1);
+    int answer = -1;
+    for (int j = y0; j < y1; j++) {
+        for (int i = x0; i < x1; i++) {
+            const int n = sampleCounts[i + width * j];
+            if (answer < 0 || n < answer) answer = n;
+        }
+    }
+    return answer < 0 ? 0 : answer;
+}
+
+double Film::getAverageSampleCount() const {
+    int x0, y0, x1, y1;
+    getCropRect(x0, y0, x1, y1);
+    double answer = 0.0;
+    for (int j = y0; j < y1; j++) {
+        for (int i = x0; i < x1; i++) {
+            answer += sampleCounts[i + width * j];
+        }
+    }
+    const int numCropPixels = (x1 - x0) * (y1 - y0);
+    return numCropPixels == 0 ? 0.0 : answer / numCropPixels;
+}
+
 void Film::setRenderStatus(const long long _msec, const int _spp) {
     msec = _msec;
     spp = _spp;
@@ -35,15 +128,18 @@ void Film::setRenderStatus(const long long _msec, const int _spp) {
 void Film::writeImage() {
     struct stat statBuf;
     if (stat("results", &statBuf) == -1) _mkdir("results");
-    std::string fileName = "results/" + std::to_string(msec) + "msec_" + std::to_string(spp) + "spp.ppm";
+    writeImage("results/" + std::to_string(msec) + "msec_" + std::to_string(spp) + "spp.ppm", pixels, width, height);
+    std::cout << ">> OUTPUT IMAGE : FINISH" << std::endl << std::endl;
+}
+
+void Film::writeImage(const std::string& fileName, const unsigned char* rgb, const int width, const int height) {
     std::ofstream ofs(fileName);
     ofs << "P3\n" << width << " " << height << "\n255\n";
     for (int j = height - 1; 0 <= j; j--) {
         for (int i = 0; i < width; i++) {
-            ofs << (int)pixels[(j * width + i) * 3] << " " << (int)pixels[(j * width + i) * 3 + 1] << " " << (int)pixels[(j * width + i) * 3 + 2] << "\n";
+            ofs << (int)rgb[(j * width + i) * 3] << " " << (int)rgb[(j * width + i) * 3 + 1] << " " << (int)rgb[(j * width + i) * 3 + 2] << "\n";
         }
     }
-    std::cout << ">> OUTPUT IMAGE : FINISH" << std::endl << std::endl;
 }
 
 void Film::writePixels() {
@@ -1,11 +1,25 @@
 #pragma once
 
+#include <vector>
+#include <atomic>
+#include <memory>
+
 namespace hiraishi {
     class Film {
     private:
         unsigned char *pixels;
         int numPixels;
         long long msec;
+        // linear radiance sums and sample counts, pixels is the tonemapped view of them
+        std::vector<Vec3> accumulation;
+        std::vector<int> sampleCounts;
+        // running mean and squared deviation of the luminance per pixel (Welford), clamped to 1
+        std::vector<double> meanLuminance;
+        std::vector<double> m2Luminance;
+        // light image, paths from the lights splatted to the pixel they are seen in by any thread,
+        // RGB per pixel, shown at splatScale on top of the average of the pixel
+        std::unique_ptr<std::atomic<double>[]> splats;
+        double splatScale = 0.0;
 
     public:
         Film() {}
@@ -14,15 +28,41 @@ namespace hiraishi {
         int width = 200;
         int height = 200;
         int spp;
+        // crop window from the top left of the image, only it is rendered and the rest of the film
+        // keeps what it shows, a width or height of 0 reaches the edge of the film
+        int cropX = 0;
+        int cropY = 0;
+        int cropWidth = 0;
+        int cropHeight = 0;
 
         unsigned char* getPixels() const { return pixels; }
         unsigned char getPixel(const int p) const { return pixels[p]; }
         int getNumPixels() const { return numPixels; }
+        // the crop window clamped to the film as pixel indices, [x0, x1) x [y0, y1)
+        void getCropRect(int& x0, int& y0, int& x1, int& y1) const;
+        int getNumCropPixels() const;
 
         void init();
         void setPixelColor(const Vec3& c, int p);
+        void clearAccumulation();
+        void addSample(const Vec3& c, const int p);
+        void addSamples(const Vec3& sum, const int numSamples, const int p); // no variance is tracked
+        void addSplat(const Vec3& c, const int p);
+        // 1 / light paths traced per pixel, every pixel of the crop window is redrawn
+        void setSplatScale(const double scale);
+        void updatePixelColor(const int p) { setPixelColor(getAverage(p), p); }
+        double getLuminanceMean(const int p) const { return meanLuminance[p]; }
+        double getLuminanceVariance(const int p) const { return 1 < sampleCounts[p] ? m2Luminance[p] / (sampleCounts[p] - 1) : 0.0; }
+        Vec3 getAverage(const int p) const { return (0 < sampleCounts[p] ? accumulation[p] / sampleCounts[p] : Vec3()) + getSplat(p) * splatScale; }
+        Vec3 getSplat(const int p) const { return Vec3(splats[p * 3], splats[p * 3 + 1], splats[p * 3 + 2]); }
+        int getSampleCount(const int p) const { return sampleCounts[p]; }
+        // of the pixels in the crop window
+        int getMinSampleCount() const;
+        double getAverageSampleCount() const;
         void setRenderStatus(const long long _msec, const int _spp);
         void writeImage();
+        // rgb : width * height tonemapped pixels as in getPixels, bottom row first
+        static void writeImage(const std::string& fileName, const unsigned char* rgb, const int width, const int height);
         void writePixels();
         void writePixels1(std::string filename, int offset);
     };
@@ -11,6 +11,7 @@ namespace hiraishi {
         ~Intersect() {}
 
         const Material* mtlPtr = NULL;
+        int faceIndex = -1;
         double t = H_INFINITE;
         Vec3 pos;
         Vec3 normal;
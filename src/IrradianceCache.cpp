@@ -0,0 +1,165 @@
+#include <algorithm>
+#include "Constant.h"
+#include "Vec3.h"
+#include "Materials/Material.h"
+#include "Ray.h"
+#include "BBox.h"
+#include "IrradianceCache.h"
+
+using namespace hiraishi;
+
+// radius of the records, of the scene diagonal
+static const double MIN_RADIUS = 0.005;
+static const double MAX_RADIUS = 0.1;
+
+static double luminance(const Vec3& c) {
+    return 0.2126 * c.x + 0.7152 * c.y + 0.0722 * c.z;
+}
+
+static double getChannel(const Vec3& v, const int c) {
+    return c == 0 ? v.x : c == 1 ? v.y : v.z;
+}
+
+void IrradianceCache::init(const BBox& bbox, const double error) {
+    clear();
+    maxError = error;
+    const Vec3 extent = bbox.max - bbox.min;
+    const double diagonal = extent.length();
+    minRadius = MIN_RADIUS * diagonal;
+    maxRadius = MAX_RADIUS * diagonal;
+    // a cube around the scene
+    Node root;
+    root.center = (bbox.min + bbox.max) * 0.5;
+    root.halfSize = fmax(extent.x, fmax(extent.y, extent.z)) * 0.5 * 1.01 + 1e-6;
+    nodes.push_back(root);
+}
+
+int IrradianceCache::getChild(const int node, const int octant) {
+    if (nodes[node].children[octant] < 0) {
+        Node child;
+        child.halfSize = nodes[node].halfSize * 0.5;
+        child.center = nodes[node].center + Vec3((octant & 1) ? child.halfSize : -child.halfSize,
+            (octant & 2) ? child.halfSize : -child.halfSize,
+            (octant & 4) ? child.halfSize : -child.halfSize);
+        nodes[node].children[octant] = (int)nodes.size();
+        nodes.push_back(child);
+    }
+    return nodes[node].children[octant];
+}
+
+void IrradianceCache::add(const Record& record) {
+    if (nodes.empty()) return;
+    const int index = (int)records.size();
+    records.push_back(record);
+    // the deepest node whose cube still holds the whole validity radius around its center,
+    // the record is then inside the cube of the node grown by half its size
+    const double validRadius = maxError * record.radius;
+    int node = 0;
+    while (validRadius * 2.0 < nodes[node].halfSize) {
+        const Vec3& center = nodes[node].center;
+        const int octant = (center.x < record.pos.x ? 1 : 0) | (center.y < record.pos.y ? 2 : 0) | (center.z < record.pos.z ? 4 : 0);
+        node = getChild(node, octant);
+    }
+    nodes[node].records.push_back(index);
+}
+
+bool IrradianceCache::getIrradiance(const Vec3& pos, const Vec3& normal, Vec3& irradiance) const {
+    if (nodes.empty()) return false;
+    double sumWeight = 0.0;
+    Vec3 sum(0.0, 0.0, 0.0);
+    int stack[256];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (0 < stackSize) {
+        const Node& node = nodes[stack[--stackSize]];
+        for (const int index : node.records) {
+            const Record& record = records[index];
+            const Vec3 d = pos - record.pos;
+            // a record in front of pos sees what pos does not
+            if (Vec3::dot(d, normal + record.normal) * 0.5 < -0.05 * record.radius) continue;
+            const double error = d.length() / record.radius + sqrt(fmax(0.0, 1.0 - Vec3::dot(normal, record.normal)));
+            if (maxError <= error) continue;
+            // falls to 0 at the border so that records do not pop in and out
+            const double weight = 1.0 / fmax(error, 1e-6) - 1.0 / maxError;
+            const Vec3 rotation = Vec3::cross(record.normal, normal);
+            Vec3 value;
+            value.x = record.irradiance.x + Vec3::dot(rotation, record.rotationalGradient[0]) + Vec3::dot(d, record.translationalGradient[0]);
+            value.y = record.irradiance.y + Vec3::dot(rotation, record.rotationalGradient[1]) + Vec3::dot(d, record.translationalGradient[1]);
+            value.z = record.irradiance.z + Vec3::dot(rotation, record.rotationalGradient[2]) + Vec3::dot(d, record.translationalGradient[2]);
+            sum = sum + Vec3::max(value, Vec3(0.0, 0.0, 0.0)) * weight;
+            sumWeight += weight;
+        }
+        // children whose grown cube holds pos
+        for (int octant = 0; octant < 8; octant++) {
+            const int child = node.children[octant];
+            if (child < 0 || 256 <= stackSize) continue;
+            const Node& c = nodes[child];
+            const double reach = c.halfSize * 2.0;
+            if (fabs(pos.x - c.center.x) <= reach && fabs(pos.y - c.center.y) <= reach && fabs(pos.z - c.center.z) <= reach) stack[stackSize++] = child;
+        }
+    }
+    if (sumWeight <= 0.0) return false;
+    irradiance = sum / sumWeight;
+    return true;
+}
+
+Vec3 IrradianceCache::getSampleDirection(const Vec3& normal, const int j, const int k, const int numTheta, const int numPhi, const double u1, const double u2) {
+    const double sinTheta = sqrt((j + u1) / numTheta);
+    const double phi = 2.0 * M_PI * (k + u2) / numPhi;
+    const Vec3 dirLocal(sinTheta * cos(phi), sqrt(fmax(0.0, 1.0 - sinTheta * sinTheta)), sinTheta * sin(phi));
+    return Vec3::convertVectorRelativeToN(dirLocal, normal);
+}
+
+IrradianceCache::Record IrradianceCache::makeRecord(const Vec3& pos, const Vec3& normal, const std::vector<Vec3>& radiances, const std::vector<double>& distances, const int numTheta, const int numPhi) const {
+    Record record;
+    record.pos = pos;
+    record.normal = normal;
+    const int numStrata = numTheta * numPhi;
+    double sumInverseDistance = 0.0;
+    Vec3 sum(0.0, 0.0, 0.0);
+    for (int n = 0; n < numStrata; n++) {
+        sum = sum + radiances[n];
+        sumInverseDistance += 1.0 / fmax(distances[n], 1e-6);
+    }
+    // cosine weighted, E = pi * mean L
+    record.irradiance = sum * (M_PI / numStrata);
+
+    const auto L = [&](const int j, const int k, const int c) { return getChannel(radiances[j * numPhi + ((k + numPhi) % numPhi)], c); };
+    const auto R = [&](const int j, const int k) { return distances[j * numPhi + ((k + numPhi) % numPhi)]; };
+    for (int c = 0; c < 3; c++) {
+        Vec3 rotational(0.0, 0.0, 0.0), translational(0.0, 0.0, 0.0);
+        for (int k = 0; k < numPhi; k++) {
+            const double phi = 2.0 * M_PI * (k + 0.5) / numPhi;
+            const double phiMinus = 2.0 * M_PI * k / numPhi;
+            const Vec3 u = Vec3::convertVectorRelativeToN(Vec3(cos(phi), 0.0, sin(phi)), normal);
+            const Vec3 v = Vec3::convertVectorRelativeToN(Vec3(-sin(phi), 0.0, cos(phi)), normal);
+            const Vec3 vMinus = Vec3::convertVectorRelativeToN(Vec3(-sin(phiMinus), 0.0, cos(phiMinus)), normal);
+
+            double sumTan = 0.0, sumTheta = 0.0, sumPhi = 0.0;
+            for (int j = 0; j < numTheta; j++) {
+                const double sinCenter = sqrt((j + 0.5) / numTheta);
+                sumTan -= sinCenter / sqrt(fmax(1e-6, 1.0 - sinCenter * sinCenter)) * L(j, k, c);
+                const double sinMinus = sqrt((double)j / numTheta);
+                const double sinPlus = sqrt((double)(j + 1) / numTheta);
+                // across the border of the strata j - 1 and j, then of the strata k - 1 and k
+                if (0 < j) {
+                    const double cos2Minus = 1.0 - sinMinus * sinMinus;
+                    sumTheta += sinMinus * cos2Minus / fmax(std::min(R(j, k), R(j - 1, k)), 1e-6) * (L(j, k, c) - L(j - 1, k, c));
+                }
+                sumPhi += (sinPlus - sinMinus) / fmax(std::min(R(j, k), R(j, k - 1)), 1e-6) * (L(j, k, c) - L(j, k - 1, c));
+            }
+            rotational = rotational + v * sumTan;
+            translational = translational + u * (sumTheta * 2.0 * M_PI / numPhi) + vMinus * sumPhi;
+        }
+        record.rotationalGradient[c] = rotational * (M_PI / numStrata);
+        record.translationalGradient[c] = translational;
+    }
+
+    // harmonic mean distance, no farther than the irradiance can change by the gradient
+    double radius = numStrata / sumInverseDistance;
+    const double lum = luminance(record.irradiance);
+    const Vec3 gradient = record.translationalGradient[0] * 0.2126 + record.translationalGradient[1] * 0.7152 + record.translationalGradient[2] * 0.0722;
+    if (0.0 < gradient.length()) radius = fmin(radius, lum / gradient.length());
+    record.radius = fmin(maxRadius, fmax(minRadius, radius));
+    return record;
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+namespace hiraishi {
+    // Irradiance of diffuse surfaces computed at sparse points and interpolated between them
+    // with its gradients, kept in an octree by the area each record is valid for.
+    // [Ward et al., 1988, A Ray Tracing Solution for Diffuse Interreflection]
+    // [Ward and Heckbert, 1992, Irradiance Gradients]
+    class IrradianceCache {
+    public:
+        struct Record {
+            Vec3 pos;
+            Vec3 normal;
+            Vec3 irradiance;
+            double radius = 0.0; // harmonic mean distance to the surfaces seen, clamped
+            // gradient of each of r, g and b, for rotating the normal and moving along the surface
+            Vec3 rotationalGradient[3];
+            Vec3 translationalGradient[3];
+        };
+
+    private:
+        struct Node {
+            Vec3 center;
+            double halfSize = 0.0;
+            int children[8] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+            std::vector<int> records; // whose validity radius is up to halfSize
+        };
+
+        std::vector<Record> records;
+        std::vector<Node> nodes;
+        double maxError = 0.3;   // a of Ward, the larger the sparser the records
+        double minRadius = 0.0;
+        double maxRadius = 0.0;
+
+        int getChild(const int node, const int octant);
+
+    public:
+        void init(const BBox& bbox, const double error);
+        void clear() { records.clear(); nodes.clear(); }
+
+        bool empty() const { return records.empty(); }
+        size_t size() const { return records.size(); }
+        // weighted average of the records valid at pos for the normal, false if there are none
+        bool getIrradiance(const Vec3& pos, const Vec3& normal, Vec3& irradiance) const;
+        void add(const Record& record);
+
+        // direction of the stratum (j, k) of numTheta x numPhi cosine weighted strata about normal
+        static Vec3 getSampleDirection(const Vec3& normal, const int j, const int k, const int numTheta, const int numPhi, const double u1, const double u2);
+        // record from the radiance and hit distance of every stratum, indexed j * numPhi + k
+        Record makeRecord(const Vec3& pos, const Vec3& normal, const std::vector<Vec3>& radiances, const std::vector<double>& distances, const int numTheta, const int numPhi) const;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,256 @@
+#include <algorithm>
+#include "Constant.h"
+#include "Vec3.h"
+#include "Materials/Material.h"
+#include "Ray.h"
+#include "BBox.h"
+#include "LightTree.h"
+
+using namespace hiraishi;
+
+static const int NUM_BUCKETS = 12;
+// trails have 64 bits, halving the lists below this depth still leaves room for 2^32 lights
+static const int MAX_HEURISTIC_DEPTH = 32;
+
+static double safeSqrt(const double x) {
+    return sqrt(fmax(0.0, x));
+}
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from the cos and sin of a and b
+static double cosSubClamped(const double sinA, const double cosA, const double sinB, const double cosB) {
+    if (cosB < cosA) return 1.0;
+    return cosA * cosB + sinA * sinB;
+}
+
+static double sinSubClamped(const double sinA, const double cosA, const double sinB, const double cosB) {
+    if (cosB < cosA) return 0.0;
+    return sinA * cosB - cosA * sinB;
+}
+
+static Vec3 getCenter(const BBox& bbox) {
+    return (bbox.min + bbox.max) * 0.5;
+}
+
+static double getSurfaceArea(const BBox& bbox) {
+    const Vec3 d = bbox.max - bbox.min;
+    return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+// rotate v around the unit axis by theta, Rodrigues' formula
+static Vec3 rotate(const Vec3& v, const Vec3& axis, const double theta) {
+    const double c = cos(theta), s = sin(theta);
+    return v * c + Vec3::cross(axis, v) * s + axis * (Vec3::dot(axis, v) * (1.0 - c));
+}
+
+// smallest cone around both, as pbrt-v4's DirectionCone Union
+static void uniteCones(const Vec3& axisA, const double cosA, const Vec3& axisB, const double cosB, Vec3& axis, double& cosTheta) {
+    const double thetaA = acos(fmin(fmax(cosA, -1.0), 1.0));
+    const double thetaB = acos(fmin(fmax(cosB, -1.0), 1.0));
+    const double thetaD = acos(fmin(fmax(Vec3::dot(axisA, axisB), -1.0), 1.0));
+    if (fmin(thetaD + thetaB, M_PI) <= thetaA) {
+        axis = axisA;
+        cosTheta = cosA;
+        return;
+    }
+    if (fmin(thetaD + thetaA, M_PI) <= thetaB) {
+        axis = axisB;
+        cosTheta = cosB;
+        return;
+    }
+    const double theta = (thetaA + thetaD + thetaB) * 0.5;
+    const Vec3 w = Vec3::cross(axisA, axisB);
+    if (M_PI <= theta || w.length() == 0.0) { // every direction
+        axis = axisA;
+        cosTheta = -1.0;
+        return;
+    }
+    axis = rotate(axisA, w.normalize(), theta - thetaA).normalize();
+    cosTheta = cos(theta);
+}
+
+static LightBounds unite(const LightBounds& a, const LightBounds& b) {
+    if (a.power == 0.0) return b;
+    if (b.power == 0.0) return a;
+    LightBounds answer;
+    answer.bbox = a.bbox;
+    answer.bbox.grow(b.bbox);
+    uniteCones(a.axis, a.cosTheta_o, b.axis, b.cosTheta_o, answer.axis, answer.cosTheta_o);
+    answer.power = a.power + b.power;
+    return answer;
+}
+
+// surface area orientation heuristic, the solid angle term integrates the emission cone
+static double evaluateCost(const LightBounds& b, const Vec3& extent, const int axis) {
+    const double theta_o = acos(fmin(fmax(b.cosTheta_o, -1.0), 1.0));
+    const double theta_w = fmin(theta_o + M_PI * 0.5, M_PI);
+    const double sinTheta_o = safeSqrt(1.0 - b.cosTheta_o * b.cosTheta_o);
+    const double M_omega = 2.0 * M_PI * (1.0 - b.cosTheta_o)
+        + M_PI * 0.5 * (2.0 * theta_w * sinTheta_o - cos(theta_o - 2.0 * theta_w) - 2.0 * theta_o * sinTheta_o + b.cosTheta_o);
+    // long thin nodes are split across
+    const double e[3] = { extent.x, extent.y, extent.z };
+    const double Kr = (0.0 < e[axis]) ? fmax(e[0], fmax(e[1], e[2])) / e[axis] : 1.0;
+    return b.power * M_omega * Kr * getSurfaceArea(b.bbox);
+}
+
+double LightBounds::importance(const Vec3& pos, const Vec3& normal) const {
+    const Vec3 center = getCenter(bbox);
+    const double radius2 = Vec3::dist2(bbox.max, center);
+    const double dist2 = Vec3::dist2(pos, center);
+    // keep the estimate finite near and inside the box
+    const double d2 = fmax(dist2, sqrt(radius2));
+
+    // angle between the axis and the direction to pos
+    const Vec3 wi = (dist2 == 0.0) ? axis : (pos - center).normalize();
+    const double cosTheta_w = Vec3::dot(axis, wi);
+    const double sinTheta_w = safeSqrt(1.0 - cosTheta_w * cosTheta_w);
+
+    // angle subtended by the bounding sphere
+    const double cosTheta_b = (dist2 < radius2) ? -1.0 : safeSqrt(1.0 - radius2 / dist2);
+    const double sinTheta_b = safeSqrt(1.0 - cosTheta_b * cosTheta_b);
+
+    // smallest angle between pos and an emitting direction inside the cone
+    const double sinTheta_o = safeSqrt(1.0 - cosTheta_o * cosTheta_o);
+    const double cosTheta_x = cosSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    const double sinTheta_x = sinSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    const double cosTheta_p = cosSubClamped(sinTheta_x, cosTheta_x, sinTheta_b, cosTheta_b);
+    if (cosTheta_p <= 0.0) return 0.0;
+
+    double answer = power * cosTheta_p / d2;
+
+    // lights behind the shading point are not received
+    if (normal != Vec3(0.0, 0.0, 0.0)) {
+        const double cosTheta_i = Vec3::dot(normal, -wi);
+        const double sinTheta_i = safeSqrt(1.0 - cosTheta_i * cosTheta_i);
+        answer *= fmax(0.0, cosSubClamped(sinTheta_i, cosTheta_i, sinTheta_b, cosTheta_b));
+    }
+    return answer;
+}
+
+void LightTree::init(const std::vector<LightBounds>& lights) {
+    nodes.clear();
+    trails.assign(lights.size(), 0);
+    if (lights.empty()) return;
+
+    std::vector<int> indices(lights.size());
+    for (size_t i = 0; i < lights.size(); i++) {
+        indices[i] = (int)i;
+    }
+    nodes.reserve(lights.size() * 2 - 1);
+    build(indices, 0, (int)lights.size(), lights, 0, 0);
+}
+
+int LightTree::build(std::vector<int>& lights, const int begin, const int end, const std::vector<LightBounds>& bounds, const unsigned long long trail, const int depth) {
+    const int nodeIndex = (int)nodes.size();
+    nodes.push_back(Node());
+    if (end - begin == 1) {
+        nodes[nodeIndex].bounds = bounds[lights[begin]];
+        nodes[nodeIndex].light = lights[begin];
+        trails[lights[begin]] = trail;
+        return nodeIndex;
+    }
+
+    BBox centroids;
+    centroids.min = centroids.max = getCenter(bounds[lights[begin]].bbox);
+    for (int i = begin + 1; i < end; i++) {
+        const Vec3 c = getCenter(bounds[lights[i]].bbox);
+        centroids.grow({ c, c });
+    }
+    const Vec3 extent = centroids.max - centroids.min;
+
+    // best bucket boundary over the three axes
+    int bestAxis = -1, bestBucket = -1;
+    double bestCost = H_INFINITE;
+    for (int axis = 0; axis < 3; axis++) {
+        const double lo = (axis == 0) ? centroids.min.x : (axis == 1) ? centroids.min.y : centroids.min.z;
+        const double e = (axis == 0) ? extent.x : (axis == 1) ? extent.y : extent.z;
+        if (!(0.0 < e)) continue;
+
+        LightBounds buckets[NUM_BUCKETS];
+        for (int i = begin; i < end; i++) {
+            const Vec3 c = getCenter(bounds[lights[i]].bbox);
+            const double x = (axis == 0) ? c.x : (axis == 1) ? c.y : c.z;
+            const int b = std::min(NUM_BUCKETS - 1, (int)(NUM_BUCKETS * (x - lo) / e));
+            buckets[b] = unite(buckets[b], bounds[lights[i]]);
+        }
+        for (int split = 0; split < NUM_BUCKETS - 1; split++) {
+            LightBounds below, above;
+            for (int b = 0; b <= split; b++) below = unite(below, buckets[b]);
+            for (int b = split + 1; b < NUM_BUCKETS; b++) above = unite(above, buckets[b]);
+            if (below.power == 0.0 || above.power == 0.0) continue;
+            const double cost = evaluateCost(below, extent, axis) + evaluateCost(above, extent, axis);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBucket = split;
+            }
+        }
+    }
+
+    int mid = (begin + end) / 2;
+    if (bestAxis != -1 && depth < MAX_HEURISTIC_DEPTH) {
+        const double lo = (bestAxis == 0) ? centroids.min.x : (bestAxis == 1) ? centroids.min.y : centroids.min.z;
+        const double e = (bestAxis == 0) ? extent.x : (bestAxis == 1) ? extent.y : extent.z;
+        const int* p = std::partition(lights.data() + begin, lights.data() + end, [&](const int l) {
+            const Vec3 c = getCenter(bounds[l].bbox);
+            const double x = (bestAxis == 0) ? c.x : (bestAxis == 1) ? c.y : c.z;
+            return std::min(NUM_BUCKETS - 1, (int)(NUM_BUCKETS * (x - lo) / e)) <= bestBucket;
+        });
+        mid = (int)(p - lights.data());
+    }
+    // the heuristic found nothing, or the trail would run out of bits: halve the list
+    if (mid == begin || mid == end) {
+        mid = (begin + end) / 2;
+    }
+
+    build(lights, begin, mid, bounds, trail, depth + 1);
+    const int second = build(lights, mid, end, bounds, trail | (1ull << depth), depth + 1);
+    nodes[nodeIndex].secondChild = second;
+    nodes[nodeIndex].bounds = unite(nodes[nodeIndex + 1].bounds, nodes[second].bounds);
+    return nodeIndex;
+}
+
+int LightTree::sample(const Vec3& pos, const Vec3& normal, double u, double& prob) const {
+    prob = 0.0;
+    if (nodes.empty()) return -1;
+    double p = 1.0;
+    int n = 0;
+    while (nodes[n].light < 0) {
+        const double i0 = nodes[n + 1].bounds.importance(pos, normal);
+        const double i1 = nodes[nodes[n].secondChild].bounds.importance(pos, normal);
+        if (!(0.0 < i0 + i1)) return -1;
+        const double p0 = i0 / (i0 + i1);
+        // the remaining part of u picks among the children below
+        if (u < p0) {
+            u = fmin(u / p0, 1.0 - 1e-12);
+            p *= p0;
+            n = n + 1;
+        }
+        else {
+            u = fmin((u - p0) / (1.0 - p0), 1.0 - 1e-12);
+            p *= 1.0 - p0;
+            n = nodes[n].secondChild;
+        }
+    }
+    prob = p;
+    return nodes[n].light;
+}
+
+double LightTree::getProb(const Vec3& pos, const Vec3& normal, const int light) const {
+    const unsigned long long trail = trails[light];
+    double p = 1.0;
+    int n = 0;
+    for (int depth = 0; nodes[n].light < 0; depth++) {
+        const double i0 = nodes[n + 1].bounds.importance(pos, normal);
+        const double i1 = nodes[nodes[n].secondChild].bounds.importance(pos, normal);
+        if (!(0.0 < i0 + i1)) return 0.0;
+        if (trail & (1ull << depth)) {
+            p *= i1 / (i0 + i1);
+            n = nodes[n].secondChild;
+        }
+        else {
+            p *= i0 / (i0 + i1);
+            n = n + 1;
+        }
+    }
+    return p;
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+namespace hiraishi {
+    // what LightTree keeps of a set of emissive faces
+    struct LightBounds {
+        BBox bbox;
+        Vec3 axis;               // the normals are within theta_o of it
+        double cosTheta_o = 1.0; // faces emit in the hemisphere around their normal (theta_e = pi/2)
+        double power = 0.0;
+
+        // estimate of the light received at pos from the faces inside, 0 if none can reach it
+        double importance(const Vec3& pos, const Vec3& normal) const;
+    };
+
+    // Binary tree over emissive faces, traversed with probabilities in proportion to
+    // the importance of each child for the shading point. [Conty Estevez and Kulla, 2018]
+    class LightTree {
+    private:
+        struct Node {
+            LightBounds bounds;
+            int secondChild = -1; // the first child follows the node
+            int light = -1;       // index of the face for a leaf
+        };
+
+        std::vector<Node> nodes;
+        std::vector<unsigned long long> trails; // per light, bit d is the child taken at depth d
+
+        int build(std::vector<int>& lights, const int begin, const int end, const std::vector<LightBounds>& bounds, const unsigned long long trail, const int depth);
+
+    public:
+        void init(const std::vector<LightBounds>& lights);
+
+        bool empty() const { return nodes.empty(); }
+        size_t getNumNodes() const { return nodes.size(); }
+        // index of the picked light and its probability, -1 if no light can reach pos
+        int sample(const Vec3& pos, const Vec3& normal, double u, double& prob) const;
+        double getProb(const Vec3& pos, const Vec3& normal, const int light) const;
+    };
+}
\ No newline at end of file
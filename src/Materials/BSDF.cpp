@@ -98,33 +98,59 @@ double BSDF::evaluateD(const Vec3& wm) const {
     return 1.0 / (M_PI * ax * ay * (denom * denom));
 }
 
-Vec3 BSDF::DisneyBRDF(double& pdf) const {
-    const Vec3 normalLocal(0.0, 1.0, 0.0);
-    const Vec3 woLocal = Vec3::convertVectorRelativeToN(-ray.d, normalLocal);
-    const Vec3 wiLocal = Vec3::convertVectorRelativeToN(isect.wi, normalLocal);
+// surfaces are lit on the side of the incoming ray
+Vec3 BSDF::facingNormal() const {
+    return Vec3::dot(isect.normal, ray.d) < 0.0 ? isect.normal : -isect.normal;
+}
+
+bool BSDF::isGlossy() const {
+    return isect.mtlPtr->illum == 5 && 0.0 < isect.mtlPtr->roughness;
+}
+
+bool BSDF::isDelta() const {
+    const int illum = isect.mtlPtr->illum;
+    return (illum == 5 && !isGlossy()) || illum == 7;
+}
+
+bool BSDF::isSmooth() const {
+    return isect.mtlPtr->illum == 2 || isGlossy();
+}
+
+void BSDF::setDirection(const Vec3& wi) {
+    isect.wi = wi;
+    cosTerm = Vec3::absDot(wi, isect.normal);
+}
+
+Vec3 BSDF::getReflectionNormal() const {
+    return isGlossy() ? facingNormal() : isect.normal;
+}
+
+// GGX reflection, wo and wi in the frame of the facing normal (y up)
+Vec3 BSDF::microfacetBRDF(const Vec3& wi, double& pdf) const {
+    const Vec3 n = facingNormal();
+    const Vec3 woLocal = Vec3::convertVectorToLocalOfN(-ray.d, n);
+    const Vec3 wiLocal = Vec3::convertVectorToLocalOfN(wi, n);
+    pdf = 0.0;
+    if (cosTheta(woLocal) <= 0.0 || cosTheta(wiLocal) <= 0.0) return Vec3(0.0, 0.0, 0.0);
     const Vec3 wmLocal = (woLocal + wiLocal).normalize();
     const Vec3 F = evaluateF(woLocal, wmLocal);
     const double G = evaluateG(woLocal, wiLocal, wmLocal);
     const double D = evaluateD(wmLocal);
-    const double dotHL = Vec3::absDot(wmLocal, wiLocal);
-    pdf = (G * abs(cosTheta(wiLocal)) / dotHL) * D / (4.0 * dotHL);
-    return F * G * D / (4.0 * Vec3::dot(woLocal, wmLocal) * Vec3::dot(wiLocal, wmLocal));
+    // wm is sampled in proportion to D * cos, reflecting about it has the jacobian 1 / (4 wo.wm)
+    pdf = D * cosTheta(wmLocal) / (4.0 * Vec3::absDot(woLocal, wmLocal));
+    return F * G * D / (4.0 * cosTheta(woLocal) * cosTheta(wiLocal));
 }
 
 // Sample Microfacet Normal(wm)
-Vec3 BSDF::sampleMicrofacetNormal(Random& rng) {
+Vec3 BSDF::sampleMicrofacetNormal(Random& rng) const {
     const double r1 = rng.next();
     const double r2 = rng.next();
-    const double roughness = isect.mtlPtr->roughness;
-    const double aspect = sqrt(1.0 - 0.9 * isect.mtlPtr->anisotopic);
-    ax = roughness * roughness / aspect;
-    ay = roughness * roughness * aspect;
     // orthonormal basis(y up)
     const Vec3 n(0.0, 1.0, 0.0);
     const Vec3 x(1.0, 0.0, 0.0);
     const Vec3 z(0.0, 0.0, 1.0);
     const Vec3 wm = (x * (ax * cos(2.0 * M_PI * r1)) + (z * (ay * sin(2.0 * M_PI * r1)))) * sqrt(r2 / (1.0 - r2)) + n;
-    return Vec3::convertVectorRelativeToN(wm, isect.normal);
+    return Vec3::convertVectorRelativeToN(wm, facingNormal());
 }
 
 Vec3 BSDF::evaluateDirection(Random& rng) {
@@ -139,8 +165,7 @@ Vec3 BSDF::evaluateDirection(Random& rng) {
         }
         else {
             isect.wm = sampleMicrofacetNormal(rng);
-            isect.wi = mirrorReflectDir(dir, isect.wm);
-            dir = isect.wi;
+            dir = mirrorReflectDir(isect.wm, ray.d);
         }
     }
     else if (isect.mtlPtr->illum == 7) { // glass
@@ -148,6 +173,8 @@ Vec3 BSDF::evaluateDirection(Random& rng) {
         const double n2 = isect.mtlPtr->Ni;
         dir = fresnelDir(isect.normal, ray.d, n1, n2, rng.next());
     }
+    isect.wi = dir;
+    cosTerm = Vec3::absDot(dir, isect.normal);
     return dir;
 }
 
@@ -158,12 +185,12 @@ Vec3 BSDF::evaluateBSDF(double& pdf) const {
         pdf = cosTerm / M_PI;
     }
     else if (isect.mtlPtr->illum == 5) { // specular
-        // todo
         if (isect.mtlPtr->roughness == 0.0) {
             pdf = cosTerm;
         }
         else {
-            fs = DisneyBRDF(pdf);
+            fs = microfacetBRDF(isect.wi, pdf);
+            if (pdf == 0.0) pdf = 1.0; // reflected below the surface, fs is zero
         }
     }
     else if (isect.mtlPtr->illum == 7) { // glass
@@ -174,21 +201,21 @@ Vec3 BSDF::evaluateBSDF(double& pdf) const {
     return fs;
 }
 
-Vec3 BSDF::evaluateSpectrumDirection(Random& rng) {
-    Vec3 dir(0.0, 0.0, 0.0);
-    if (isect.mtlPtr->illum == 2) { // diffuse
-        const Vec3 dirLocal = randomReflectDir(rng);
-        dir = Vec3::convertVectorRelativeToN(dirLocal, isect.normal);
-    }
-    else if (isect.mtlPtr->illum == 5) { // mirror
-        dir = mirrorReflectDir(isect.normal, ray.d);
+Vec3 BSDF::evaluateBSDF(const Vec3& wi, double& pdf) const {
+    pdf = 0.0;
+    if (isDelta()) return Vec3(0.0, 0.0, 0.0);
+    if (isGlossy()) return microfacetBRDF(wi, pdf);
+    if (isect.mtlPtr->illum == 2) {
+        pdf = fmax(0.0, Vec3::dot(wi, isect.normal)) / M_PI;
+        if (pdf == 0.0) return Vec3(0.0, 0.0, 0.0); // below the surface
     }
-    else if (isect.mtlPtr->illum == 7) { // glass
-        const double n1 = 1.0; // air
-        const double n2 = isect.mtlPtr->Ni;
-        dir = fresnelDir(isect.normal, ray.d, n1, n2, rng.next());
-    }
-    return dir;
+    // other illum are lit as diffuse but never sampled
+    return isect.mtlPtr->Kd / M_PI;
+}
+
+// the microfacet F is grey, so directions are sampled as in RGB
+Vec3 BSDF::evaluateSpectrumDirection(Random& rng) {
+    return evaluateDirection(rng);
 }
 
 Spectrum BSDF::evaluateSpectrumBSDF(double& pdf, const Spectrum& kd) const {
@@ -198,12 +225,28 @@ Spectrum BSDF::evaluateSpectrumBSDF(double& pdf, const Spectrum& kd) const {
         pdf = cosTerm / M_PI;
     }
     else if (isect.mtlPtr->illum == 5) { // specular
-        // todo
-        pdf = cosTerm;
+        if (isect.mtlPtr->roughness == 0.0) {
+            pdf = cosTerm;
+        }
+        else {
+            fs = Spectrum(microfacetBRDF(isect.wi, pdf).y);
+            if (pdf == 0.0) pdf = 1.0; // reflected below the surface, fs is zero
+        }
     }
     else if (isect.mtlPtr->illum == 7) { // glass
         // todo
         pdf = cosTerm;
     }
     return fs;
+}
+
+Spectrum BSDF::evaluateSpectrumBSDF(const Vec3& wi, double& pdf, const Spectrum& kd) const {
+    pdf = 0.0;
+    if (isDelta()) return Spectrum(0.0);
+    if (isGlossy()) return Spectrum(microfacetBRDF(wi, pdf).y);
+    if (isect.mtlPtr->illum == 2) {
+        pdf = fmax(0.0, Vec3::dot(wi, isect.normal)) / M_PI;
+        if (pdf == 0.0) return Spectrum(0.0);
+    }
+    return kd / M_PI;
 }
\ No newline at end of file
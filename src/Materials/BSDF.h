@@ -13,22 +13,49 @@ namespace hiraishi {
         Vec3 refractDir(const Vec3& n, const Vec3& dir, const double ior) const;
         Vec3 fresnelDir(const Vec3& n, const Vec3& dir, const double n1, const double n2, const double p) const;
         double fresnelSchlickApprox(const double ior, const double cosd) const;
-        Vec3 DisneyBRDF(double& pdf) const;
+        Vec3 microfacetBRDF(const Vec3& wi, double& pdf) const;
         Vec3 evaluateF(const Vec3& w, const Vec3& wm) const;
         double smithGGXG1(const Vec3& w) const;
         double evaluateG(const Vec3& wo, const Vec3& wi, const Vec3& wm) const;
         double evaluateD(const Vec3& wm) const;
-        Vec3 sampleMicrofacetNormal(Random& rng);
+        Vec3 sampleMicrofacetNormal(Random& rng) const;
+        Vec3 facingNormal() const;
+        bool isGlossy() const;
 
     public:
         BSDF() {}
-        BSDF(const Ray& ray, const Intersect& isect, const double cosTerm) : ray(ray), isect(isect), cosTerm(cosTerm) {}
+        BSDF(const Ray& ray, const Intersect& isect, const double cosTerm) : ray(ray), isect(isect), cosTerm(cosTerm) {
+            if (isGlossy()) {
+                const double roughness = isect.mtlPtr->roughness;
+                const double aspect = sqrt(1.0 - 0.9 * isect.mtlPtr->anisotopic);
+                ax = roughness * roughness / aspect;
+                ay = roughness * roughness * aspect;
+            }
+        }
         ~BSDF() {}
 
         static Vec3 randomDirSphere(Random& rng);
+        // only one direction can leave, the light cannot be sampled
+        bool isDelta() const;
+        // a lobe that evaluateDirection samples, so directions from another distribution
+        // can be weighted with evaluateBSDF(wi, pdf)
+        bool isSmooth() const;
+        const Material* getMaterial() const { return isect.mtlPtr; }
+        // |cos| of the sampled direction after evaluateDirection, of the incoming ray before
+        double getCosTerm() const { return cosTerm; }
+
+        // sample a direction, then fs and pdf of that direction
         Vec3 evaluateDirection(Random& rng);
         Vec3 evaluateBSDF(double& pdf) const;
         Vec3 evaluateSpectrumDirection(Random& rng);
         Spectrum evaluateSpectrumBSDF(double& pdf, const Spectrum& kd) const;
+
+        // fs and the solid angle pdf of evaluateDirection for a direction found by light sampling
+        Vec3 evaluateBSDF(const Vec3& wi, double& pdf) const;
+        Spectrum evaluateSpectrumBSDF(const Vec3& wi, double& pdf, const Spectrum& kd) const;
+        // continue along a direction sampled elsewhere instead of evaluateDirection
+        void setDirection(const Vec3& wi);
+        // side of the surface the smooth lobes reflect to
+        Vec3 getReflectionNormal() const;
     };
 }
\ No newline at end of file
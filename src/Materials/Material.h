@@ -20,6 +20,8 @@ namespace hiraishi {
             Ks = m.Ks;
             Ke = m.Ke;
             Tf = m.Tf;
+            roughness = m.roughness;
+            anisotopic = m.anisotopic;
         }
         Material(const std::string _name, const double _Ns, const double _Ni, const double _Tr, const double _d, const int _illum, const Vec3 _Ka, const Vec3 _Kd, const Vec3 _Ks, const Vec3 _Ke, const Vec3 _Tf) {
             name = _name;
@@ -62,6 +64,8 @@ namespace hiraishi {
             Ks = m.Ks;
             Ke = m.Ke;
             Tf = m.Tf;
+            roughness = m.roughness;
+            anisotopic = m.anisotopic;
             return *this;
         }
     };
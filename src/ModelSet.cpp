@@ -3,6 +3,9 @@
 #include <sstream>
 #include <assert.h>
 #include <ctype.h>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
 #include "Random.h"
 #include "Vec3.h"
 #include "Sampler.h"
@@ -12,8 +15,11 @@
 #include "Face.h"
 #include "Sphere.h"
 #include "Intersect.h"
+#include "QuantizedMesh.h"
 #include "Accelerator/KdTree.h"
 #include "ModelSet.h"
+#include "SceneFile.h"
+#include "ThreadPool.h"
 
 using namespace hiraishi;
 
@@ -48,6 +54,14 @@ void ModelSet::readMtl(const char *filename) {
             const double d = std::stof(words[1]);
             materials[materials.size() - 1].d = d;
         }
+        else if (words[0] == "Pr") { // PBR extension, roughness of illum 5
+            const double pr = std::stof(words[1]);
+            materials[materials.size() - 1].roughness = pr;
+        }
+        else if (words[0] == "aniso") {
+            const double aniso = std::stof(words[1]);
+            materials[materials.size() - 1].anisotopic = aniso;
+        }
         else if (words[0] == "illum") {
             const int il = std::stoi(words[1]);
             materials[materials.size() - 1].illum = il;
@@ -86,17 +100,147 @@ void ModelSet::readMtl(const char *filename) {
     fclose(fp);
 }
 
+// obj indices are 1-origin, negative ones are relative to the end of the list read so far
+static long resolveIndex(const long index, const size_t numRead) {
+    return index < 0 ? (long)numRead + index + 1 : index;
+}
+
+// Ear clipping in the plane of the polygon's Newell normal.
+// tris receives corner triples in the polygon's winding, falls back to a fan if no ear is found.
+static void triangulatePolygon(const std::vector<Vec3>& p, std::vector<int>& tris) {
+    const int n = (int)p.size();
+    Vec3 normal(0.0, 0.0, 0.0);
+    for (int i = 0; i < n; i++) {
+        const Vec3& a = p[i];
+        const Vec3& b = p[(i + 1) % n];
+        normal.x += (a.y - b.y) * (a.z + b.z);
+        normal.y += (a.z - b.z) * (a.x + b.x);
+        normal.z += (a.x - b.x) * (a.y + b.y);
+    }
+    // project onto the plane perpendicular to the dominant axis
+    const double ax = fabs(normal.x), ay = fabs(normal.y), az = fabs(normal.z);
+    std::vector<double> u(n), v(n);
+    double sign;
+    for (int i = 0; i < n; i++) {
+        if (az >= ax && az >= ay) { u[i] = p[i].x; v[i] = p[i].y; }
+        else if (ax >= ay) { u[i] = p[i].y; v[i] = p[i].z; }
+        else { u[i] = p[i].z; v[i] = p[i].x; }
+    }
+    if (az >= ax && az >= ay) sign = normal.z < 0.0 ? -1.0 : 1.0;
+    else if (ax >= ay) sign = normal.x < 0.0 ? -1.0 : 1.0;
+    else sign = normal.y < 0.0 ? -1.0 : 1.0;
+
+    auto area2 = [&](int a, int b, int c) {
+        return ((u[b] - u[a]) * (v[c] - v[a]) - (u[c] - u[a]) * (v[b] - v[a])) * sign;
+    };
+
+    std::vector<int> remain(n);
+    for (int i = 0; i < n; i++) remain[i] = i;
+    while (3 < remain.size()) {
+        const int m = (int)remain.size();
+        bool isClipped = false;
+        for (int k = 0; k < m && !isClipped; k++) {
+            const int a = remain[(k + m - 1) % m];
+            const int b = remain[k];
+            const int c = remain[(k + 1) % m];
+            if (area2(a, b, c) <= 0.0) continue; // reflex or degenerate corner
+            bool isEar = true;
+            for (int j = 0; j < m && isEar; j++) {
+                const int q = remain[j];
+                if (q == a || q == b || q == c) continue;
+                if (0.0 <= area2(a, b, q) && 0.0 <= area2(b, c, q) && 0.0 <= area2(c, a, q)) isEar = false;
+            }
+            if (!isEar) continue;
+            tris.push_back(a);
+            tris.push_back(b);
+            tris.push_back(c);
+            remain.erase(remain.begin() + k);
+            isClipped = true;
+        }
+        if (!isClipped) break;
+    }
+    for (int i = 1; i + 1 < (int)remain.size(); i++) {
+        tris.push_back(remain[0]);
+        tris.push_back(remain[i]);
+        tris.push_back(remain[i + 1]);
+    }
+}
+
+static const size_t objReadBlockSize = 1 << 22;
+static const size_t objChunkSize = 1 << 15;
+
+// faces of one block of the .obj, set up by a worker while the parser reads on
+struct ObjChunk {
+    std::vector<Face> faces;
+    std::vector<Vec3> corners; // 3 per face, copied by the parser so workers never touch the growing vertices
+    std::chrono::system_clock::time_point start;
+    std::chrono::system_clock::time_point end;
+};
+
+static void setupObjChunk(ObjChunk* chunk) {
+    chunk->start = std::chrono::system_clock::now();
+    for (size_t i = 0; i < chunk->faces.size(); i++) {
+        chunk->faces[i].makeEquation(chunk->corners[i * 3], chunk->corners[i * 3 + 1], chunk->corners[i * 3 + 2]);
+    }
+    std::vector<Vec3>().swap(chunk->corners);
+    chunk->end = std::chrono::system_clock::now();
+}
+
+static long long msecBetween(const std::chrono::system_clock::time_point& t0, const std::chrono::system_clock::time_point& t1) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
+}
+
 void ModelSet::readObj(const char *filename) {
+    // Parsing runs on this thread. Every objChunkSize faces are handed to the pool,
+    // which makes their equations while the rest of the file is read. The kd-tree is
+    // built over all faces at the end, chunks in file order overlap too much to be joined.
     FILE *fp;
-    fopen_s(&fp, filename, "r");
+    fopen_s(&fp, filename, "rb");
+
+    const auto start = std::chrono::system_clock::now();
+    ThreadPool pool;
+    std::vector<std::unique_ptr<ObjChunk>> chunks;
+    std::unique_ptr<ObjChunk> chunk(new ObjChunk());
+    std::vector<Face> lateFaces; // faces referring to vertices defined after them
+    size_t chunkFaces = 0;
+    size_t numDropped = 0;       // faces with an index out of the file or without a material
+
+    auto dispatch = [&]() {
+        if (chunk->faces.size() == 0) return;
+        ObjChunk* c = chunk.get();
+        chunks.push_back(std::move(chunk));
+        chunk.reset(new ObjChunk());
+        pool.push([c]() { setupObjChunk(c); });
+    };
+
+    // isFinal : every vertex is known, a face that is still unresolved is dropped
+    auto pushFace = [&](const Face& f, const bool isFinal) {
+        if (f.getMtlIndex() < 0) {
+            numDropped++;
+            return;
+        }
+        for (int i = 0; i < 3; i++) {
+            const long vi = f.getVIndex(i);
+            if (vi < 1 || (long)vertices.size() < vi) {
+                if (isFinal) numDropped++;
+                else lateFaces.push_back(f);
+                return;
+            }
+        }
+        chunk->faces.push_back(f);
+        chunkFaces++;
+        for (int i = 0; i < 3; i++) {
+            chunk->corners.push_back(vertices[f.getVIndex(i) - 1]);
+        }
+        if (objChunkSize <= chunk->faces.size()) dispatch();
+    };
 
     int curMtlIndex = -1;
-    int geoIndex = 0;
-    while (1) {
-        char str[256];
-        if (fgets(str, 256, fp) == NULL) break;
-        std::vector<std::string> words = getWords(str);
-        if (words.size() == 0 || words[0] == "#") continue;
+    std::vector<long> polyV, polyVt, polyVn;
+    std::vector<Vec3> polyPos;
+    std::vector<int> polyTris;
+    size_t numTriangulated = 0;
+    auto parseLine = [&](char *str) {
         if (str[0] == 'v') {
             Vec3 v;
             if (isblank(str[1])) {
@@ -111,45 +255,64 @@ void ModelSet::readObj(const char *filename) {
                 sscanf_s(str, "vt %lf %lf %lf", &v.x, &v.y, &v.z);
                 texCoords.push_back(v);
             }
+            return;
         }
-        else if (str[0] == 'f') {
-            Face f;
-            if (words[1].find("/") != std::string::npos) {
-                for (int i = 1; i <= 3; i++) {
-                    std::vector<std::string> components = split_naive(words[i], '/');
-                    f.appendVIndex(std::stoi(components[0]));
-                    if (components.size() == 2) {
-                        f.appendVtIndex(std::stoi(components[1]));
-                    }
-                    else if (components.size() == 3) {
-                        f.appendVnIndex(std::stoi(components[1]));
-                        f.appendVtIndex(std::stoi(components[2]));
-                    }
+        std::vector<std::string> words = getWords(str);
+        if (words.size() == 0 || words[0] == "#") return;
+        if (str[0] == 'f') {
+            // polygons are triangulated here, so every face is a triangle
+            polyV.clear();
+            polyVt.clear();
+            polyVn.clear();
+            for (size_t i = 1; i < words.size(); i++) {
+                std::vector<std::string> components = split_naive(words[i], '/');
+                if (components.size() == 0) continue;
+                polyV.push_back(resolveIndex(std::stol(components[0]), vertices.size()));
+                if (components.size() == 2) {
+                    polyVt.push_back(resolveIndex(std::stol(components[1]), texCoords.size()));
+                }
+                else if (components.size() == 3) {
+                    polyVn.push_back(resolveIndex(std::stol(components[1]), vNormals.size()));
+                    polyVt.push_back(resolveIndex(std::stol(components[2]), texCoords.size()));
                 }
-                f.setMtlPtr(&materials[curMtlIndex]);
-                addFace(f);
+            }
+            if (polyV.size() < 3) return;
+
+            polyTris.clear();
+            if (polyV.size() == 3) {
+                polyTris.push_back(0);
+                polyTris.push_back(1);
+                polyTris.push_back(2);
             }
             else {
-                char *sp = &str[1];
-                while (*sp != '\n' && *sp != '\0') {
-                    while (isblank(*sp)) sp++;
-                    if (*sp == '\n' || *sp == '\0') break;
-                    char word[256];
-                    char *wp = word;
-                    while (!isblank(*sp) && *sp != '\n' && *sp != '\0') {
-                        *wp++ = *sp++;
-                    }
-                    *wp = 0;
-                    if (atoi(word) < 0) {
-                        const long v = vertices.size() + atoi(word) + 1;
-                        f.appendVIndex((long)v);
-                    }
-                    else {
-                        f.appendVIndex(atoi(word));
+                polyPos.clear();
+                for (size_t i = 0; i < polyV.size(); i++) {
+                    if (polyV[i] < 1 || (long)vertices.size() < polyV[i]) break;
+                    polyPos.push_back(vertices[polyV[i] - 1]);
+                }
+                if (polyPos.size() == polyV.size()) {
+                    triangulatePolygon(polyPos, polyTris);
+                }
+                else { // forward reference, positions are unknown yet
+                    for (int i = 1; i + 1 < (int)polyV.size(); i++) {
+                        polyTris.push_back(0);
+                        polyTris.push_back(i);
+                        polyTris.push_back(i + 1);
                     }
                 }
-                f.setMtlPtr(&materials[curMtlIndex]);
-                addFace(f);
+                numTriangulated++;
+            }
+
+            for (size_t t = 0; t < polyTris.size(); t += 3) {
+                Face f;
+                for (int i = 0; i < 3; i++) {
+                    const int c = polyTris[t + i];
+                    f.appendVIndex(polyV[c]);
+                    if (c < (int)polyVn.size()) f.appendVnIndex(polyVn[c]);
+                    if (c < (int)polyVt.size()) f.appendVtIndex(polyVt[c]);
+                }
+                if (0 <= curMtlIndex) f.setMtl(curMtlIndex, materials[curMtlIndex]);
+                pushFace(f, false);
             }
         }
         else if (words[0] == "usemtl") {
@@ -159,9 +322,65 @@ void ModelSet::readObj(const char *filename) {
                 }
             }
         }
-    }
+    };
 
+    // read in large blocks and parse the complete lines, the partial last line is carried over
+    std::vector<char> block(objReadBlockSize + 1);
+    size_t carry = 0;
+    while (true) {
+        if (carry == block.size() - 1) block.resize(block.size() * 2);
+        const size_t numRead = fread(block.data() + carry, 1, block.size() - 1 - carry, fp);
+        const size_t size = carry + numRead;
+        size_t lineStart = 0;
+        for (size_t i = 0; i < size; i++) {
+            if (block[i] != '\n') continue;
+            block[i] = 0;
+            if (lineStart < i && block[i - 1] == '\r') block[i - 1] = 0;
+            if (block[lineStart] != 0) parseLine(&block[lineStart]);
+            lineStart = i + 1;
+        }
+        if (numRead == 0) {
+            block[size] = 0;
+            if (lineStart < size) parseLine(&block[lineStart]);
+            break;
+        }
+        carry = size - lineStart;
+        memmove(block.data(), block.data() + lineStart, carry);
+    }
     fclose(fp);
+    dispatch();
+
+    // faces with forward references can be set up now that every vertex is known
+    for (size_t i = 0; i < lateFaces.size(); i++) {
+        pushFace(lateFaces[i], true);
+    }
+    dispatch();
+    const auto parseEnd = std::chrono::system_clock::now();
+
+    pool.wait();
+    const auto setupEnd = std::chrono::system_clock::now();
+
+    faces.reserve(faces.size() + chunkFaces);
+    for (size_t i = 0; i < chunks.size(); i++) {
+        faces.insert(faces.end(), chunks[i]->faces.begin(), chunks[i]->faces.end());
+    }
+    kdTree.init(getFaces(), getNumFaces());
+    const auto end = std::chrono::system_clock::now();
+
+    // the equations overlap the parse, so they are reported as the span from the first to the last chunk
+    auto equationStart = setupEnd, equationEnd = start;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        equationStart = std::min(equationStart, chunks[i]->start);
+        equationEnd = std::max(equationEnd, chunks[i]->end);
+    }
+    if (chunks.size() == 0) equationStart = equationEnd = setupEnd;
+    std::cout << ">> Load : " << filename << " " << vertices.size() << " vertices, " << faces.size() << " faces, "
+        << chunks.size() << " chunks on " << pool.getNumThreads() << " threads" << std::endl
+        << ">> Load : Triangulated " << numTriangulated << " polygons" << std::endl
+        << ">> Load : Dropped " << numDropped << " faces with an invalid vertex index or no material" << std::endl
+        << ">> Load : Parse " << msecBetween(start, parseEnd) << "msec" << std::endl
+        << ">> Load : Face Equations " << msecBetween(start, equationStart) << " - " << msecBetween(start, equationEnd) << "msec" << std::endl
+        << ">> Load : kdTree " << msecBetween(setupEnd, end) << "msec" << std::endl;
 }
 
 std::vector<std::string> getWords(char *str) {
@@ -172,27 +391,111 @@ std::vector<std::string> getWords(char *str) {
     return split_naive(line, ' ');
 }
 
+// bit pattern of a position, -0.0 is folded into 0.0
+struct WeldKey {
+    double x, y, z;
+    bool operator==(const WeldKey& k) const { return x == k.x && y == k.y && z == k.z; }
+};
+
+struct WeldKeyHash {
+    size_t operator()(const WeldKey& k) const {
+        uint64_t b[3];
+        memcpy(b, &k, sizeof(b));
+        uint64_t h = 14695981039346656037ull;
+        for (int i = 0; i < 3; i++) {
+            h = (h ^ b[i]) * 1099511628211ull;
+            h ^= h >> 29;
+        }
+        return (size_t)h;
+    }
+};
+
+void ModelSet::weldVertices() {
+    const auto start = std::chrono::system_clock::now();
+    const size_t numBefore = vertices.size();
+
+    // keep the first occurrence of every position and point the faces at it
+    std::unordered_map<WeldKey, long, WeldKeyHash> firstIndex;
+    firstIndex.reserve(vertices.size());
+    std::vector<long> remap(vertices.size());
+    std::vector<Vec3> welded;
+    welded.reserve(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const WeldKey key = { vertices[i].x + 0.0, vertices[i].y + 0.0, vertices[i].z + 0.0 };
+        auto it = firstIndex.find(key);
+        if (it == firstIndex.end()) {
+            firstIndex[key] = (long)welded.size();
+            remap[i] = (long)welded.size();
+            welded.push_back(vertices[i]);
+        }
+        else {
+            remap[i] = it->second;
+        }
+    }
+    for (std::vector<Face>::iterator f = faces.begin(); f != faces.end(); f++) {
+        for (int i = 0; i < 3; i++) {
+            f->setVIndex(i, remap[f->getVIndex(i) - 1] + 1);
+        }
+    }
+    vertices.swap(welded);
+
+    const auto end = std::chrono::system_clock::now();
+    std::cout << ">> Load : Weld " << numBefore << " -> " << vertices.size() << " vertices "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "msec" << std::endl;
+}
+
+bool ModelSet::readSceneFile(const char *filename) {
+    std::shared_ptr<SceneFile> file = std::make_shared<SceneFile>();
+    if (!file->open(filename)) return false;
+
+    // materials hold a std::string and are few, so only they are copied out of the file
+    const SceneFile::MaterialRecord* mtls = (const SceneFile::MaterialRecord*)file->getSection(SceneFile::SECTION_MATERIALS);
+    materials.clear();
+    for (size_t i = 0; i < file->getCount(SceneFile::SECTION_MATERIALS); i++) {
+        materials.push_back(mtls[i].toMaterial());
+    }
+
+    mappedVertices = (const Vec3*)file->getSection(SceneFile::SECTION_VERTICES);
+    numMappedVertices = file->getCount(SceneFile::SECTION_VERTICES);
+    mappedVNormals = (const Vec3*)file->getSection(SceneFile::SECTION_VNORMALS);
+    numMappedVNormals = file->getCount(SceneFile::SECTION_VNORMALS);
+    mappedFaces = (const Face*)file->getSection(SceneFile::SECTION_FACES);
+    numMappedFaces = file->getCount(SceneFile::SECTION_FACES);
+    if (0 < file->getCount(SceneFile::SECTION_KDNODES)) {
+        kdTree.setExternal((const Node*)file->getSection(SceneFile::SECTION_KDNODES), file->getCount(SceneFile::SECTION_KDNODES),
+                           (const int*)file->getSection(SceneFile::SECTION_KDFACES), file->getCount(SceneFile::SECTION_KDFACES));
+    }
+    vertices.clear();
+    vNormals.clear();
+    faces.clear();
+    sceneFile = file;
+    return true;
+}
+
+bool ModelSet::writeSceneFile(const char *filename, const char *objPath, const char *mtlPath, const bool weld, const bool withKdTree) const {
+    return SceneFile::write(filename, *this, SceneFile::makeSource(objPath, mtlPath, weld), withKdTree);
+}
+
 void ModelSet::printFaces() {
-    for (unsigned int i = 0; i < vertices.size(); i++) {
-        printf("v %f %f %f\n", vertices[i].x, vertices[i].y, vertices[i].z);
+    for (unsigned int i = 0; i < getNumVertices(); i++) {
+        printf("v %f %f %f\n", getVertices()[i].x, getVertices()[i].y, getVertices()[i].z);
     }
 }
 
 void ModelSet::makeFaceEquations() {
     for (std::vector<Face>::iterator f = faces.begin(); f != faces.end(); f++) {
-        std::vector<long> vi = f->getVIndices();
-        f->makeEquation(vertices[vi[0] - 1], vertices[vi[1] - 1], vertices[vi[2] - 1]);
+        f->makeEquation(vertices[f->getVIndex(0) - 1], vertices[f->getVIndex(1) - 1], vertices[f->getVIndex(2) - 1]);
     }
 }
 
 void ModelSet::initKdTree() {
     std::cout << ">> kdTree : Generating" << std::endl;
-    kdTree.init(faces);
+    kdTree.init(getFaces(), getNumFaces());
     std::cout << ">> kdTree : FINISH" << std::endl << std::endl;
 }
 
 void ModelSet::initVColor() {
-    for (int i = 0; i < vertices.size(); i++) {
+    for (size_t i = 0; i < getNumVertices(); i++) {
         vColors.push_back(Vec3(0.75, 0.75, 0.75));
     }
 }
@@ -217,22 +520,29 @@ std::vector<std::string> split_naive(const std::string &s, char delim) {
 
 Intersect ModelSet::intersect(const Ray& ray) const {
     Intersect isect;
+    if (quantizedMesh) {
+        kdTree.intersectQuantized(0, ray, isect, *quantizedMesh, materials.data());
+        return isect;
+    }
+    if (isFloatTraversal) {
+        intersectFloat(ray, isect);
+        return isect;
+    }
 #if 1 // Use Kd-Tree
-    Node* node = NULL;
-    bool isIsect = kdTree.intersect(node, ray, isect, vertices);
+    kdTree.intersect(0, ray, isect, getVertices(), getFaces(), materials.data());
 #else 
-    Material* isectMtl;
-    for (std::vector<Face>::const_iterator f = faces.begin(); f != faces.end(); f++) {
+    for (const Face* f = getFaces(); f != getFaces() + getNumFaces(); f++) {
         Vec3 isectPos, isectNormal;
         double t;
         Vec3 v[3];
         for (int i = 0; i < 3; i++) {
-            v[i] = vertices[f->getVIndex(i) - 1];
+            v[i] = getVertices()[f->getVIndex(i) - 1];
         }
-        if (!f->intersect(v, ray, &t, isectPos, isectNormal, &isectMtl)) continue;
+        if (!f->intersect(v, ray, &t, isectPos, isectNormal)) continue;
         if (t < isect.t) {
             isect.t = t;
-            isect.mtlPtr = isectMtl;
+            isect.mtlPtr = &materials[f->getMtlIndex()];
+            isect.faceIndex = (int)(f - getFaces());
             isect.pos = isectPos;
             isect.normal = isectNormal;
         }
@@ -241,33 +551,310 @@ Intersect ModelSet::intersect(const Ray& ray) const {
     return isect;
 }
 
-Vec3 ModelSet::randomPosOnLight(Random& rng) const {
-    //const int r = rng.intNext(0, geometries[lightIndex].getNumFaces() - 1);
-    //const Face f = geometries[lightIndex].getFace(r);
+Intersect ModelSet::getIntersect(const Ray& ray, const int faceIndex, const double t) const {
+    Intersect isect;
+    if (faceIndex < 0) return isect;
+    isect.t = t;
+    isect.pos = ray.o + ray.d * t;
+    isect.normal = getFaceNormal(faceIndex);
+    isect.mtlPtr = &materials[getFaceMtlIndex(faceIndex)];
+    isect.faceIndex = faceIndex;
+    return isect;
+}
+
+void ModelSet::initFloatTraversal() {
+    kdTree.initFloat(getVertices(), getFaces());
+    isFloatTraversal = true;
+    const size_t doubleBytes = kdTree.getNumNodes() * sizeof(Node) + kdTree.getNumFaceIndices() * sizeof(int)
+        + getNumFaces() * sizeof(Face) + getNumVertices() * sizeof(Vec3);
+    std::cout << ">> kdTree : Float traversal " << kdTree.getFloatBytes() / 1024 << "KB (double path reads "
+        << doubleBytes / 1024 << "KB)" << std::endl;
+}
+
+bool ModelSet::intersectFloat(const Ray& ray, Intersect& isect) const {
+    RayF rayF;
+    rayF.o = Vec3f(ray.o);
+    rayF.d = Vec3f(ray.d);
+    rayF.invD = Vec3f(1.0f / rayF.d.x, 1.0f / rayF.d.y, 1.0f / rayF.d.z);
+    // the origin is rounded to float, keep the self intersection threshold above that error
+    const double maxAbs = fmax(fabs(ray.o.x), fmax(fabs(ray.o.y), fabs(ray.o.z)));
+    rayF.tMin = (float)fmax(H_EPSILON, maxAbs * 1e-5);
+
+    float t = (float)H_INFINITE;
+    int faceIndex = -1;
+    if (!kdTree.intersectFloat(0, rayF, t, faceIndex)) return false;
+
+    // hit attributes are made in double from the original face
+    const Face& face = getFaces()[faceIndex];
+    Vec3 v[3];
+    for (int i = 0; i < 3; i++) {
+        v[i] = getVertices()[face.getVIndex(i) - 1];
+    }
+    double td;
+    Vec3 isectPos, isectNormal;
+    if (face.intersect(v, ray, &td, isectPos, isectNormal)) {
+        isect.t = td;
+        isect.pos = isectPos;
+        isect.normal = isectNormal;
+    }
+    else { // grazing hit only found in float
+        isect.t = t;
+        isect.pos = ray.o + ray.d * t;
+        isect.normal = face.getNormal();
+    }
+    isect.mtlPtr = &materials[face.getMtlIndex()];
+    isect.faceIndex = faceIndex;
+    return true;
+}
+
+// random rays between two points of the box, shared by the checks of the reduced precision paths
+static std::vector<Ray> makeCheckRays(const BBox& box, const int numRays) {
+    Random rng(42);
+    const Vec3 size = box.max - box.min;
+    std::vector<Ray> rays(numRays);
+    for (int i = 0; i < numRays; i++) {
+        // component by component, the order of evaluation of arguments is up to the compiler
+        Vec3 o, target;
+        o.x = rng.next();
+        o.y = rng.next();
+        o.z = rng.next();
+        target.x = rng.next();
+        target.y = rng.next();
+        target.z = rng.next();
+        o = box.min + size * o;
+        target = box.min + size * target;
+        rays[i] = Ray(o, target - o);
+    }
+    return rays;
+}
+
+static void reportCheck(const char* name, const std::vector<Intersect>& refHits, const std::vector<Intersect>& hits,
+                        const long long refMsec, const long long msec) {
+    int numHitMismatch = 0;
+    int numSurfaceMismatch = 0;
+    int numBothHit = 0;
+    double maxError = 0.0;
+    double sumError = 0.0;
+    for (size_t i = 0; i < refHits.size(); i++) {
+        const bool hitRef = refHits[i].t != H_INFINITE;
+        const bool hit = hits[i].t != H_INFINITE;
+        if (hitRef != hit) {
+            numHitMismatch++;
+            continue;
+        }
+        if (!hitRef) continue;
+        numBothHit++;
+        if (refHits[i].mtlPtr != hits[i].mtlPtr || Vec3::dot(refHits[i].normal, hits[i].normal) < 0.999) numSurfaceMismatch++;
+        const double error = fabs(hits[i].t - refHits[i].t) / refHits[i].t;
+        maxError = fmax(maxError, error);
+        sumError += error;
+    }
+    std::cout << ">> " << name << " : Check " << refHits.size() << " rays, double " << refMsec << "msec, " << name << " " << msec << "msec" << std::endl
+        << ">> " << name << " : Check hit mismatch " << numHitMismatch << ", surface mismatch " << numSurfaceMismatch
+        << ", t error avg " << (0 < numBothHit ? sumError / numBothHit : 0.0) << " max " << maxError << std::endl;
+}
+
+void ModelSet::checkFloatPrecision(const int numRays) const {
+    // trace the same random rays through both paths and compare the hits
+    const std::vector<Ray> rays = makeCheckRays(kdTree.getNodes()[0].bbox, numRays);
+    std::vector<Intersect> doubleHits(numRays);
+    const auto doubleStart = std::chrono::system_clock::now();
+    for (int i = 0; i < numRays; i++) {
+        kdTree.intersect(0, rays[i], doubleHits[i], getVertices(), getFaces(), materials.data());
+    }
+    const auto doubleEnd = std::chrono::system_clock::now();
+    std::vector<Intersect> floatHits(numRays);
+    for (int i = 0; i < numRays; i++) {
+        intersectFloat(rays[i], floatHits[i]);
+    }
+    const auto floatEnd = std::chrono::system_clock::now();
+    reportCheck("Float", doubleHits, floatHits,
+                std::chrono::duration_cast<std::chrono::milliseconds>(doubleEnd - doubleStart).count(),
+                std::chrono::duration_cast<std::chrono::milliseconds>(floatEnd - doubleEnd).count());
+}
+
+void ModelSet::compressGeometry(const int numCheckRays) {
+    const size_t fullBytes = getNumVertices() * sizeof(Vec3) + getNumVNormals() * sizeof(Vec3) + getNumFaces() * sizeof(Face);
+    std::shared_ptr<QuantizedMesh> mesh = std::make_shared<QuantizedMesh>();
+    mesh->init(getVertices(), getNumVertices(), getFaces(), getNumFaces());
+    kdTree.expandBounds(mesh->getMaxError());
+
+    // compare against the full geometry before it is released
+    const std::vector<Ray> rays = makeCheckRays(kdTree.getNodes()[0].bbox, numCheckRays);
+    std::vector<Intersect> fullHits(numCheckRays);
+    const auto fullStart = std::chrono::system_clock::now();
+    for (int i = 0; i < numCheckRays; i++) {
+        kdTree.intersect(0, rays[i], fullHits[i], getVertices(), getFaces(), materials.data());
+    }
+    const auto fullEnd = std::chrono::system_clock::now();
+    std::vector<Intersect> quantizedHits(numCheckRays);
+    for (int i = 0; i < numCheckRays; i++) {
+        kdTree.intersectQuantized(0, rays[i], quantizedHits[i], *mesh, materials.data());
+    }
+    const auto quantizedEnd = std::chrono::system_clock::now();
+    reportCheck("Quantized", fullHits, quantizedHits,
+                std::chrono::duration_cast<std::chrono::milliseconds>(fullEnd - fullStart).count(),
+                std::chrono::duration_cast<std::chrono::milliseconds>(quantizedEnd - fullEnd).count());
+
+    // vertex normals are not used in shading, so they are released without an encoded copy
+    std::vector<Vec3>().swap(vertices);
+    std::vector<Vec3>().swap(vNormals);
+    std::vector<Face>().swap(faces);
+    mappedVertices = NULL;
+    mappedVNormals = NULL;
+    mappedFaces = NULL;
+    sceneFile.reset();
+    quantizedMesh = mesh;
+
+    const Vec3 maxError = mesh->getMaxError();
+    std::cout << ">> Quantized : Geometry " << mesh->getBytes() / 1024 << "KB (was " << fullBytes / 1024 << "KB), max position error "
+        << fmax(fmax(maxError.x, maxError.y), maxError.z) << std::endl;
+}
+
+size_t ModelSet::getFaceVIndex(const size_t faceIndex, const int i) const {
+    if (quantizedMesh) return quantizedMesh->getFaceVIndex(faceIndex, i);
+    return getFaces()[faceIndex].getVIndex(i) - 1;
+}
+
+Vec3 ModelSet::getFaceVertex(const size_t faceIndex, const int i) const {
+    if (quantizedMesh) return quantizedMesh->getFaceVertex(faceIndex, i);
+    return getVertices()[getFaces()[faceIndex].getVIndex(i) - 1];
+}
+
+Vec3 ModelSet::getFaceNormal(const size_t faceIndex) const {
+    if (quantizedMesh) return quantizedMesh->getFaceNormal(faceIndex);
+    return getFaces()[faceIndex].getNormal();
+}
+
+int ModelSet::getFaceMtlIndex(const size_t faceIndex) const {
+    if (quantizedMesh) return quantizedMesh->getFaceMtlIndex(faceIndex);
+    return getFaces()[faceIndex].getMtlIndex();
+}
+
+size_t ModelSet::getNumFaces() const {
+    if (quantizedMesh) return quantizedMesh->getNumFaces();
+    return mappedFaces ? numMappedFaces : faces.size();
+}
+
+BBox ModelSet::getBBox() const {
+    BBox bbox;
+    const size_t numFaces = getNumFaces();
+    for (size_t f = 0; f < numFaces; f++) {
+        for (int i = 0; i < 3; i++) {
+            const Vec3 v = getFaceVertex(f, i);
+            if (f == 0 && i == 0) bbox.min = bbox.max = v;
+            bbox.grow({ v, v });
+        }
+    }
+    return bbox;
+}
+
+static double getEmittedLuminance(const Material& mtl) {
+    return 0.2126 * mtl.Ke.x + 0.7152 * mtl.Ke.y + 0.0722 * mtl.Ke.z;
+}
+
+void ModelSet::initLights(const bool withLightTree) {
+    lightFaces.clear();
+    lightAreas.clear();
+    std::vector<double> powers;
+    std::vector<LightBounds> bounds;
+    lightPower = 0.0;
+    const size_t numFaces = getNumFaces();
+    for (size_t i = 0; i < numFaces; i++) {
+        const int mtlIndex = getFaceMtlIndex(i);
+        if (mtlIndex < 0 || (int)materials.size() <= mtlIndex) continue;
+        const double luminance = getEmittedLuminance(materials[mtlIndex]);
+        if (!(0.0 < luminance)) continue;
+
+        const Vec3 v0 = getFaceVertex(i, 0);
+        const Vec3 v1 = getFaceVertex(i, 1);
+        const Vec3 v2 = getFaceVertex(i, 2);
+        const double area = Vec3::cross(v1 - v0, v2 - v0).length() * 0.5;
+        if (!(0.0 < area)) continue;
+        lightFaces.push_back((int)i);
+        lightAreas.push_back(area);
+        powers.push_back(luminance * area);
+        lightPower += luminance * area;
+
+        if (withLightTree) {
+            LightBounds b;
+            b.bbox.min = b.bbox.max = v0;
+            b.bbox.grow({ v1, v1 });
+            b.bbox.grow({ v2, v2 });
+            b.axis = getFaceNormal(i);
+            b.power = luminance * area;
+            bounds.push_back(b);
+        }
+    }
+    lightTable.init(powers);
+    lightTree.init(bounds);
+    std::cout << ">> Light : " << lightFaces.size() << " emissive faces";
+    if (!lightTree.empty()) std::cout << ", light tree " << lightTree.getNumNodes() << " nodes";
+    std::cout << std::endl;
+}
+
+double ModelSet::getLightPdf(const Vec3& pos, const Vec3& normal, const Intersect& lightIsect) const {
+    if (!hasLights()) return 0.0;
+    if (lightTree.empty()) {
+        // power * area over the total power, divided by the area
+        return getEmittedLuminance(*lightIsect.mtlPtr) / lightPower;
+    }
+    const std::vector<int>::const_iterator it = std::lower_bound(lightFaces.begin(), lightFaces.end(), lightIsect.faceIndex);
+    if (it == lightFaces.end() || *it != lightIsect.faceIndex) return 0.0;
+    const int k = (int)(it - lightFaces.begin());
+    return lightTree.getProb(pos, normal, k) / lightAreas[k];
+}
+
+LightSample ModelSet::sampleLight(const Vec3& pos, const Vec3& normal, Random& rng) const {
+    LightSample answer;
+    double prob;
+    int k;
+    if (lightTree.empty()) {
+        k = lightTable.sample(rng.next());
+        prob = lightTable.getProb(k);
+    }
+    else {
+        k = lightTree.sample(pos, normal, rng.next(), prob);
+        if (k < 0) return answer;
+    }
+    const int faceIndex = lightFaces[k];
+    Vec3 v[3];
+    for (int i = 0; i < 3; i++) {
+        v[i] = getFaceVertex(faceIndex, i);
+    }
+    // drawn one by one, the order of evaluation of arguments is up to the compiler
+    const double u1 = rng.next();
+    const double u2 = rng.next();
+    answer.pos = Sampler::uniformSampleTriangle(v, u1, u2);
+    answer.normal = getFaceNormal(faceIndex);
+    answer.mtlPtr = &materials[getFaceMtlIndex(faceIndex)];
+    answer.pdf = prob / lightAreas[k];
+    answer.faceIndex = faceIndex;
+    return answer;
+}
+
+LightSample ModelSet::sampleEmission(Random& rng) const {
+    LightSample answer;
+    if (lightFaces.empty()) return answer;
+    const int k = lightTable.sample(rng.next());
+    const int faceIndex = lightFaces[k];
     Vec3 v[3];
     for (int i = 0; i < 3; i++) {
-        //v[i] = vertices[f.getVIndex(i) - 1];
+        v[i] = getFaceVertex(faceIndex, i);
     }
-    Vec3 answer = Sampler::uniformSampleTriangle(v, rng.next(), rng.next());
+    const double u1 = rng.next();
+    const double u2 = rng.next();
+    answer.pos = Sampler::uniformSampleTriangle(v, u1, u2);
+    answer.normal = getFaceNormal(faceIndex);
+    answer.mtlPtr = &materials[getFaceMtlIndex(faceIndex)];
+    answer.pdf = lightTable.getProb(k) / lightAreas[k];
+    answer.faceIndex = faceIndex;
     return answer;
 }
 
-void ModelSet::initLightArea() {
-    //double answer = 0.0;
-    //for (int i = 0; i < geometries[lightIndex].getNumFaces(); i++) {
-    //    const Face f = geometries[lightIndex].getFace(i);
-    //    Vec3 v[3];
-    //    for (int j = 0; j < 3; j++) {
-    //        v[j] = vertices[f.getVIndex(j) - 1];
-    //    }
-    //    // calculate area per face
-    //    const Vec3 va1 = v[1] - v[0];
-    //    const Vec3 va2 = v[2] - v[0];
-    //    const double dot = Vec3::dot(va1, va2);
-    //    const double area = sqrt(va1.length2() * va2.length2() - dot * dot);
-    //    answer += area;
-    //}
-    //lightArea = answer;
+double ModelSet::getEmissionPdf(const Material& mtl) const {
+    // power * area over the total power, divided by the area
+    return hasLights() ? getEmittedLuminance(mtl) / lightPower : 0.0;
 }
 
 void ModelSet::addFace(Face f) {
@@ -1,6 +1,22 @@
 #pragma once
 
+#include <memory>
+#include "AliasTable.h"
+#include "LightTree.h"
+
 namespace hiraishi {
+    class SceneFile;
+    class QuantizedMesh;
+
+    // point picked on an emissive face
+    struct LightSample {
+        Vec3 pos;
+        Vec3 normal;
+        const Material* mtlPtr = NULL;
+        double pdf = 0.0; // per unit area, 0 with a zero normal if no light reaches the shading point
+        int faceIndex = -1;
+    };
+
     class ModelSet {
     private:
         std::vector<Vec3> vertices;
@@ -10,8 +26,29 @@ namespace hiraishi {
         std::vector<Material> materials;
         std::vector<Face> faces;
 
-        int lightIndex;
-        double lightArea;
+        // sections of a mapped SceneFile, used in place of the vectors above if not NULL
+        std::shared_ptr<SceneFile> sceneFile;
+        const Vec3* mappedVertices = NULL;
+        const Vec3* mappedVNormals = NULL;
+        const Face* mappedFaces = NULL;
+        size_t numMappedVertices = 0;
+        size_t numMappedVNormals = 0;
+        size_t numMappedFaces = 0;
+
+        // replaces all of the above after compressGeometry()
+        std::shared_ptr<QuantizedMesh> quantizedMesh;
+
+        bool isFloatTraversal = false;
+
+        bool intersectFloat(const Ray& ray, Intersect& isect) const;
+
+        // faces with Ke > 0 in face order, picked in proportion to power * area,
+        // or by the importance for the shading point if lightTree is made
+        std::vector<int> lightFaces;
+        std::vector<double> lightAreas;
+        AliasTable lightTable;
+        double lightPower = 0.0; // sum of the weights of lightTable
+        LightTree lightTree;
 
     public:
         ModelSet() {}
@@ -21,20 +58,49 @@ namespace hiraishi {
 
         void readMtl(const char *filename);
         void readObj(const char *filename);
+        void weldVertices();
+        bool readSceneFile(const char *filename);
+        // the .obj/.mtl and the weld it was loaded with are kept to tell whether the file is up to date
+        bool writeSceneFile(const char *filename, const char *objPath, const char *mtlPath, const bool weld, const bool withKdTree = true) const;
         void printFaces();
         void makeFaceEquations();
         void initKdTree();
         void initVColor();
-        
+        void initFloatTraversal();
+        void checkFloatPrecision(const int numRays) const;
+        void compressGeometry(const int numCheckRays);
+
         void setVColor(const Vec3& color, const int vi) { vColors[vi] = color; }
-        const std::vector<Vec3>& getVertices() const { return vertices; }
-        const std::vector<Vec3>& getVNormals() const { return vNormals; }
+        const Vec3* getVertices() const { return mappedVertices ? mappedVertices : vertices.data(); }
+        size_t getNumVertices() const { return mappedVertices ? numMappedVertices : vertices.size(); }
+        const Vec3* getVNormals() const { return mappedVNormals ? mappedVNormals : vNormals.data(); }
+        size_t getNumVNormals() const { return mappedVNormals ? numMappedVNormals : vNormals.size(); }
+        const Face* getFaces() const { return mappedFaces ? mappedFaces : faces.data(); }
+        size_t getNumFaces() const;
+        BBox getBBox() const;
+        // per face access that also works on compressed geometry
+        size_t getFaceVIndex(const size_t faceIndex, const int i) const; // 0 origin
+        Vec3 getFaceVertex(const size_t faceIndex, const int i) const;
+        Vec3 getFaceNormal(const size_t faceIndex) const;
+        int getFaceMtlIndex(const size_t faceIndex) const;
+        bool isCompressed() const { return quantizedMesh != NULL; }
         const std::vector<Vec3>& getVColors() const { return vColors; }
-        const std::vector<Face>& getFaces() const { return faces; }
-        const double& getLightArea() const { return lightArea; }
+        const std::vector<Material>& getMaterials() const { return materials; }
+        bool hasKdTree() const { return 0 < kdTree.getNumNodes(); }
         Intersect intersect(const Ray& ray) const;
-        Vec3 randomPosOnLight(Random& rng) const;
-        void initLightArea();
+        // the hit intersect() gives for a ray whose nearest face and distance are already known
+        Intersect getIntersect(const Ray& ray, const int faceIndex, const double t) const;
+        void initLights(const bool withLightTree = false);
+        bool hasLights() const { return !lightFaces.empty(); }
+        size_t getNumLights() const { return lightFaces.size(); }
+        // light for the shading point at pos, normal may be zero inside a medium
+        LightSample sampleLight(const Vec3& pos, const Vec3& normal, Random& rng) const;
+        // pdf per unit area of sampleLight choosing the point hit by lightIsect
+        double getLightPdf(const Vec3& pos, const Vec3& normal, const Intersect& lightIsect) const;
+        // light picked in proportion to its power wherever it is seen from, for paths leaving the lights
+        LightSample sampleEmission(Random& rng) const;
+        // pdf per unit area of sampleEmission choosing a point of a face with this material
+        double getEmissionPdf(const Material& mtl) const;
         void addFace(Face f);
     };
 }
\ No newline at end of file
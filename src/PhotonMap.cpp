@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <utility>
+#include "Constant.h"
+#include "Vec3.h"
+#include "PhotonMap.h"
+
+using namespace hiraishi;
+
+static const int MAX_NEIGHBORS = 256;
+
+static double getAxis(const Vec3& v, const int axis) {
+    return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+// max heap of the photons found so far, the farthest on top
+struct PhotonMap::Neighbors {
+    int k = 0;
+    int size = 0;
+    double maxDist2 = 0.0; // of the farthest photon once k are found
+    std::pair<double, int> heap[MAX_NEIGHBORS];
+
+    void add(const double dist2, const int index) {
+        if (size < k) {
+            heap[size++] = std::make_pair(dist2, index);
+            std::push_heap(heap, heap + size);
+            if (size == k) maxDist2 = heap[0].first;
+        }
+        else {
+            std::pop_heap(heap, heap + size);
+            heap[size - 1] = std::make_pair(dist2, index);
+            std::push_heap(heap, heap + size);
+            maxDist2 = heap[0].first;
+        }
+    }
+};
+
+void PhotonMap::init(std::vector<Photon>& stored) {
+    photons.swap(stored);
+    stored.clear();
+    build(0, (int)photons.size());
+}
+
+void PhotonMap::build(const int begin, const int end) {
+    if (end <= begin) return;
+    // split the longest side of the range at its median
+    Vec3 min = photons[begin].pos, max = photons[begin].pos;
+    for (int i = begin + 1; i < end; i++) {
+        min = Vec3::min(min, photons[i].pos);
+        max = Vec3::max(max, photons[i].pos);
+    }
+    const Vec3 extent = max - min;
+    const int axis = (extent.y < extent.x && extent.z < extent.x) ? 0 : (extent.z < extent.y ? 1 : 2);
+    const int median = (begin + end) / 2;
+    std::nth_element(photons.begin() + begin, photons.begin() + median, photons.begin() + end, [axis](const Photon& a, const Photon& b) {
+        return getAxis(a.pos, axis) < getAxis(b.pos, axis);
+    });
+    photons[median].axis = axis;
+    build(begin, median);
+    build(median + 1, end);
+}
+
+void PhotonMap::findNearest(const Vec3& pos, const int begin, const int end, Neighbors& neighbors) const {
+    if (end <= begin) return;
+    const int median = (begin + end) / 2;
+    const Photon& photon = photons[median];
+    const double d = getAxis(pos, photon.axis) - getAxis(photon.pos, photon.axis);
+    // the side of pos first, the other only if the splitting plane is nearer than the farthest found
+    if (d < 0.0) {
+        findNearest(pos, begin, median, neighbors);
+        if (d * d < neighbors.maxDist2) findNearest(pos, median + 1, end, neighbors);
+    }
+    else {
+        findNearest(pos, median + 1, end, neighbors);
+        if (d * d < neighbors.maxDist2) findNearest(pos, begin, median, neighbors);
+    }
+    const double dist2 = Vec3::dist2(pos, photon.pos);
+    if (dist2 < neighbors.maxDist2) neighbors.add(dist2, median);
+}
+
+Vec3 PhotonMap::getIrradiance(const Vec3& pos, const Vec3& normal, const int k, const double maxDist) const {
+    if (photons.empty()) return Vec3(0.0, 0.0, 0.0);
+    Neighbors neighbors;
+    neighbors.k = std::min(std::max(k, 1), MAX_NEIGHBORS);
+    neighbors.maxDist2 = maxDist * maxDist;
+    findNearest(pos, 0, (int)photons.size(), neighbors);
+    if (neighbors.size == 0) return Vec3(0.0, 0.0, 0.0);
+
+    Vec3 flux(0.0, 0.0, 0.0);
+    for (int i = 0; i < neighbors.size; i++) {
+        const Photon& photon = photons[neighbors.heap[i].second];
+        if (0.0 < Vec3::dot(photon.wi, normal)) flux = flux + photon.power;
+    }
+    // the disc reaches the farthest photon found, or maxDist if fewer than k were
+    const double radius2 = (neighbors.size == neighbors.k) ? neighbors.maxDist2 : maxDist * maxDist;
+    return flux / (M_PI * radius2);
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+namespace hiraishi {
+    // Photons stored on surfaces, kept as a balanced kd-tree for k nearest neighbour
+    // density estimation. [Jensen, 1996, Global Illumination using Photon Maps]
+    class PhotonMap {
+    public:
+        struct Photon {
+            Vec3 pos;
+            Vec3 wi;    // toward where the photon came from
+            Vec3 power; // flux
+            int axis = 0;
+        };
+
+    private:
+        // the median of every range is the node splitting it, the halves are its children
+        std::vector<Photon> photons;
+
+        struct Neighbors;
+        void build(const int begin, const int end);
+        void findNearest(const Vec3& pos, const int begin, const int end, Neighbors& neighbors) const;
+
+    public:
+        // takes the photons, sorting them into the tree
+        void init(std::vector<Photon>& stored);
+        void clear() { photons.clear(); }
+
+        bool empty() const { return photons.empty(); }
+        size_t size() const { return photons.size(); }
+        // flux over the area of the disc holding the k photons nearest to pos, from the side of normal,
+        // no farther than maxDist
+        Vec3 getIrradiance(const Vec3& pos, const Vec3& normal, const int k, const double maxDist) const;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include <vector>
+#include <math.h>
+#include "Constant.h"
+#include "Vec3.h"
+#include "Materials/Material.h"
+#include "Ray.h"
+#include "BBox.h"
+#include "Face.h"
+#include "QuantizedMesh.h"
+
+using namespace hiraishi;
+
+static double signNotZero(const double v) {
+    return v < 0.0 ? -1.0 : 1.0;
+}
+
+void QuantizedMesh::init(const Vec3* vertices, const size_t numVertices, const Face* faces, const size_t numFaces) {
+    Vec3 vMin(H_INFINITE, H_INFINITE, H_INFINITE);
+    Vec3 vMax(-H_INFINITE, -H_INFINITE, -H_INFINITE);
+    for (size_t i = 0; i < numVertices; i++) {
+        vMin = Vec3::min(vMin, vertices[i]);
+        vMax = Vec3::max(vMax, vertices[i]);
+    }
+    if (numVertices == 0) vMin = vMax = Vec3();
+    origin = vMin;
+    step = (vMax - vMin) / 65535.0;
+
+    qVertices.resize(numVertices);
+    const double* stepAxis[3] = { &step.x, &step.y, &step.z };
+    for (size_t i = 0; i < numVertices; i++) {
+        const Vec3 d = vertices[i] - origin;
+        const double dAxis[3] = { d.x, d.y, d.z };
+        for (int a = 0; a < 3; a++) {
+            const double q = 0.0 < *stepAxis[a] ? floor(dAxis[a] / *stepAxis[a] + 0.5) : 0.0;
+            qVertices[i].q[a] = (uint16_t)fmin(fmax(q, 0.0), 65535.0);
+        }
+    }
+
+    qFaces.resize(numFaces);
+    for (size_t i = 0; i < numFaces; i++) {
+        QFace& q = qFaces[i];
+        for (int j = 0; j < 3; j++) {
+            q.vIndices[j] = (uint32_t)(faces[i].getVIndex(j) - 1);
+        }
+        q.normal = encodeNormal(faces[i].getNormal());
+        q.mtlIndex = (uint16_t)faces[i].getMtlIndex();
+        q.isTwoSided = faces[i].getIsTwoSided() ? 1 : 0;
+    }
+}
+
+bool QuantizedMesh::intersect(const size_t faceIndex, const Ray& ray, double* tParam, Vec3& isectPos, Vec3& isectNormal) const {
+    // same test as Face::intersect on the decoded face
+    const QFace& face = qFaces[faceIndex];
+    const Vec3 o = ray.o;
+    const Vec3 d = ray.d;
+    const Vec3 n = decodeNormal(face.normal);
+    if (!face.isTwoSided) {
+        const double dot = Vec3::dot(n, -d);
+        if (dot < H_EPSILON) return false;
+    }
+
+    const Vec3 v0 = getVertex(face.vIndices[0]);
+    const Vec3 e1 = getVertex(face.vIndices[1]) - v0;
+    const Vec3 e2 = getVertex(face.vIndices[2]) - v0;
+    const Vec3 alpha = Vec3::cross(d, e2);
+    const double det = Vec3::dot(e1, alpha);
+    if (-H_EPSILON < det && det < H_EPSILON) return false;
+
+    const double invDet = 1.0 / det;
+    const Vec3 r = o - v0;
+    const double u = Vec3::dot(alpha, r) * invDet;
+    if (u < 0.0 || 1.0 < u) return false;
+
+    const Vec3 beta = Vec3::cross(r, e1);
+    const double v = Vec3::dot(d, beta) * invDet;
+    if (v < 0.0 || 1.0 < u + v) return false;
+
+    const double t = Vec3::dot(e2, beta) * invDet;
+    if (t < H_EPSILON) return false;
+
+    *tParam = t;
+    isectPos = o + d * t;
+    isectNormal = n;
+    return true;
+}
+
+uint32_t QuantizedMesh::encodeNormal(const Vec3& n) {
+    // project on the octahedron |x|+|y|+|z|=1 and fold the lower half over the upper one
+    const double l1 = fabs(n.x) + fabs(n.y) + fabs(n.z);
+    if (!(0.0 < l1)) return encodeNormal(Vec3(0.0, 0.0, 1.0));
+    double u = n.x / l1;
+    double v = n.y / l1;
+    if (n.z < 0.0) {
+        const double pu = u;
+        u = (1.0 - fabs(v)) * signNotZero(pu);
+        v = (1.0 - fabs(pu)) * signNotZero(v);
+    }
+    const int16_t qu = (int16_t)floor(fmin(fmax(u, -1.0), 1.0) * 32767.0 + 0.5);
+    const int16_t qv = (int16_t)floor(fmin(fmax(v, -1.0), 1.0) * 32767.0 + 0.5);
+    return (uint32_t)(uint16_t)qu | ((uint32_t)(uint16_t)qv << 16);
+}
+
+Vec3 QuantizedMesh::decodeNormal(const uint32_t n) {
+    const double u = (int16_t)(uint16_t)(n & 0xffff) / 32767.0;
+    const double v = (int16_t)(uint16_t)(n >> 16) / 32767.0;
+    Vec3 answer(u, v, 1.0 - fabs(u) - fabs(v));
+    if (answer.z < 0.0) {
+        answer.x = (1.0 - fabs(v)) * signNotZero(u);
+        answer.y = (1.0 - fabs(u)) * signNotZero(v);
+    }
+    return answer.normalize();
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace hiraishi {
+    // Compressed triangle storage for meshes that do not fit in memory as Vec3/Face.
+    // Positions are 16 bit per axis against the mesh bounding box, face normals are
+    // octahedral encoded, and both are decoded when a face is tested or shaded.
+    class QuantizedMesh {
+    public:
+        struct QVertex {
+            uint16_t q[3];
+        };
+
+        struct QFace {
+            uint32_t vIndices[3]; // 0 origin
+            uint32_t normal;      // octahedral, 16 bit per component
+            uint16_t mtlIndex;
+            uint16_t isTwoSided;
+        };
+
+    private:
+        std::vector<QVertex> qVertices;
+        std::vector<QFace> qFaces;
+        Vec3 origin;
+        Vec3 step; // size of one quantization step per axis
+
+    public:
+        void init(const Vec3* vertices, const size_t numVertices, const Face* faces, const size_t numFaces);
+
+        size_t getNumVertices() const { return qVertices.size(); }
+        size_t getNumFaces() const { return qFaces.size(); }
+        size_t getBytes() const { return qVertices.size() * sizeof(QVertex) + qFaces.size() * sizeof(QFace); }
+        // largest distance between a decoded position and the original one
+        Vec3 getMaxError() const { return step * 0.5; }
+
+        Vec3 getVertex(const size_t vertexIndex) const {
+            const QVertex& v = qVertices[vertexIndex];
+            return Vec3(origin.x + v.q[0] * step.x, origin.y + v.q[1] * step.y, origin.z + v.q[2] * step.z);
+        }
+        size_t getFaceVIndex(const size_t faceIndex, const int i) const { return qFaces[faceIndex].vIndices[i]; }
+        Vec3 getFaceVertex(const size_t faceIndex, const int i) const { return getVertex(qFaces[faceIndex].vIndices[i]); }
+        Vec3 getFaceNormal(const size_t faceIndex) const { return decodeNormal(qFaces[faceIndex].normal); }
+        int getFaceMtlIndex(const size_t faceIndex) const { return qFaces[faceIndex].mtlIndex; }
+
+        bool intersect(const size_t faceIndex, const Ray& ray, double* t, Vec3& isectPos, Vec3& isectNormal) const;
+
+        static uint32_t encodeNormal(const Vec3& n);
+        static Vec3 decodeNormal(const uint32_t n);
+    };
+}
\ No newline at end of file
@@ -1,19 +1,150 @@
 #pragma once
 
-#include <random>
+#include <stdint.h>
+#include "BlueNoise.h"
 
 namespace hiraishi {
+    // Counter based generator. The n-th number of a stream is a hash of (key, n), so a path
+    // draws the same numbers whichever thread renders it and in whatever tile order.
+    // The hash is the SplitMix64 finalizer [Steele et al. 2014].
+    // With isSobol the n-th number is dimension n of an Owen scrambled Sobol point instead,
+    // dimensions are paired as 2D Sobol points whose order is shuffled per pair and pixel
+    // (padded, [Burley 2020]).
+    // With blueNoise the pixels of a tile share one sequence, each pair of dimensions rotated by
+    // the 2D offset at the pixel in a BlueNoise tile moved per pair, which leaves the error of
+    // low spp as blue noise. [Georgiev and Fajardo 2016]
     struct Random {
-        std::mt19937 engine;
-        std::uniform_real_distribution<double> dist;
-        std::uniform_int_distribution<> intDist;
-        Random() {};
-        Random(int seed) {
-            engine.seed(seed);
-            dist.reset();
-            intDist.reset();
-        }
-        double next() { return dist(engine); }
-        int intNext(long min, long max) { return intDist(engine, std::uniform_int_distribution<>::param_type(min, max)); }
+        // dimensions of a path sample, a bounce takes DIMS_PER_BOUNCE from DIM_BOUNCE on
+        static const uint32_t DIM_PIXEL = 0;      // 2D position in the pixel
+        static const uint32_t DIM_WAVELENGTH = 2;
+        static const uint32_t DIM_BOUNCE = 4;
+        static const uint32_t DIMS_PER_BOUNCE = 8;
+        static const uint32_t DIM_ROULETTE = 0;   // offsets in a bounce
+        static const uint32_t DIM_LIGHT = 1;      // light choice, then a 2D point on it
+        static const uint32_t DIM_BSDF = 4;       // 2D direction
+        static const uint32_t DIM_GUIDE = 6;      // BSDF or guide
+        static const uint32_t DIM_RESERVOIR = 1u << 20; // light candidates of a reservoir, above any path
+
+        uint64_t key = 0;
+        uint64_t counter = 0; // dimensions drawn from the stream
+        uint64_t pixelKey = 0;
+        uint32_t sample = 0;
+        bool isSobol = false;
+        uint32_t pairedDimension = ~0u; // second dimension of the last Sobol pair and its value
+        double pairedValue = 0.0;
+        const float* blueNoise = nullptr; // BlueNoise::getTile()
+        int tileX = 0, tileY = 0;         // position of the pixel in the tile
+
+        Random() {}
+        Random(const uint64_t seed) : key(mix(seed)) {}
+
+        // stream of one sample of pixel (i, j), drawn from dimension 0 again
+        void start(const int i, const int j, const int width, const uint64_t sample_) {
+            uint64_t pixel = (uint64_t)i + (uint64_t)width * j;
+            if (blueNoise) {
+                // one sequence per tile, the tiles are told apart as not to repeat the error
+                pixel = ((uint64_t)(i / BlueNoise::SIZE) << 32) | (uint64_t)(j / BlueNoise::SIZE);
+                tileX = i % BlueNoise::SIZE;
+                tileY = j % BlueNoise::SIZE;
+            }
+            pixelKey = mix(pixel + 0x9E3779B97F4A7C15ull);
+            key = mix(pixelKey ^ (sample_ * 0xD1B54A32D192ED03ull));
+            sample = (uint32_t)sample_;
+            counter = 0;
+            pairedDimension = ~0u;
+        }
+        void setDimension(const uint32_t dim) { counter = dim; }
+        void setDimension(const int bounce, const uint32_t offset) { counter = DIM_BOUNCE + (uint64_t)bounce * DIMS_PER_BOUNCE + offset; }
+
+        double next() {
+            const uint32_t dim = (uint32_t)counter;
+            const double u = isSobol ? nextSobol() : nextHash();
+            return blueNoise ? rotate(u, dim) : u;
+        }
+        int intNext(long min, long max) {
+            const long n = min + (long)(next() * (double)(max - min + 1));
+            return (int)(n < max ? n : max);
+        }
+
+        static uint64_t mix(uint64_t z) {
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+    private:
+        double nextHash() {
+            counter++;
+            // upper 53 bits to [0, 1)
+            return (double)(mix(key + counter * 0x9E3779B97F4A7C15ull) >> 11) * (1.0 / 9007199254740992.0);
+        }
+
+        double rotate(const double u, const uint32_t dim) const {
+            const uint64_t offset = mix((dim >> 1) + 0x9E3779B97F4A7C15ull);
+            const int x = (tileX + (int)(offset & 0xffff)) & (BlueNoise::SIZE - 1);
+            const int y = (tileY + (int)((offset >> 16) & 0xffff)) & (BlueNoise::SIZE - 1);
+            // a digital shift, unlike adding modulo 1 it keeps the strata of a Sobol net
+            const uint32_t bits = (uint32_t)(u * 4294967296.0) ^ (uint32_t)(blueNoise[(y * BlueNoise::SIZE + x) * 2 + (dim & 1)] * 4294967296.0);
+            return (double)bits * (1.0 / 4294967296.0);
+        }
+
+        static uint32_t reverseBits(uint32_t x) {
+            x = (x << 16) | (x >> 16);
+            x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+            x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+            x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+            x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+            return x;
+        }
+
+        // Owen scrambling of the bits from the top, with the hash of [Laine and Karras 2011] improved by Burley
+        static uint32_t owenScramble(uint32_t x, const uint32_t seed) {
+            x = reverseBits(x);
+            x += seed;
+            x ^= x * 0x6c50b47cu;
+            x ^= x * 0xb82f1e52u;
+            x ^= x * 0xc7afe638u;
+            x ^= x * 0x8d22f6e6u;
+            return reverseBits(x);
+        }
+
+        // second Sobol dimension, the first is reverseBits(i). The generator matrix is applied
+        // a byte at a time from tables, the bits of a shuffled index are all in use
+        struct Sobol1Table {
+            uint32_t bytes[4][256];
+            Sobol1Table() {
+                uint32_t columns[32];
+                columns[0] = 1u << 31;
+                for (int k = 1; k < 32; k++) columns[k] = columns[k - 1] ^ (columns[k - 1] >> 1);
+                for (int b = 0; b < 4; b++) {
+                    for (uint32_t x = 0; x < 256; x++) {
+                        uint32_t answer = 0;
+                        for (int k = 0; k < 8; k++) {
+                            if (x & (1u << k)) answer ^= columns[b * 8 + k];
+                        }
+                        bytes[b][x] = answer;
+                    }
+                }
+            }
+        };
+        static uint32_t sobol1(const uint32_t i) {
+            static const Sobol1Table table;
+            return table.bytes[0][i & 0xff] ^ table.bytes[1][(i >> 8) & 0xff] ^ table.bytes[2][(i >> 16) & 0xff] ^ table.bytes[3][i >> 24];
+        }
+
+        double nextSobol() {
+            const uint32_t dim = (uint32_t)counter++;
+            if (dim == pairedDimension) return pairedValue;
+            // both dimensions of a pair see the same shuffled index, the second is kept for the next draw
+            const uint64_t pairKey = mix(pixelKey + ((dim >> 1) + 1) * 0x9E3779B97F4A7C15ull);
+            const uint32_t index = owenScramble(sample, (uint32_t)pairKey);
+            const uint32_t seed = (uint32_t)(pairKey >> 32);
+            const double x = (double)owenScramble(reverseBits(index), seed) * (1.0 / 4294967296.0);
+            const double y = (double)owenScramble(sobol1(index), seed ^ 0x68bc21ebu) * (1.0 / 4294967296.0);
+            if (dim & 1) return y;
+            pairedDimension = dim + 1;
+            pairedValue = y;
+            return x;
+        }
     };
 }
\ No newline at end of file
@@ -0,0 +1,15 @@
+#pragma once
+
+namespace hiraishi {
+    // nothing in front of a point sampled at squared distance dist2 along the shadow ray
+    inline bool isVisible(const Intersect& shadowIsect, const double dist2) {
+        const double t = shadowIsect.t * (1.0 + 1e-4);
+        return dist2 <= t * t;
+    }
+
+    // weight of a sample of one strategy, Veach 1997
+    inline double powerHeuristic(const double pdf, const double otherPdf) {
+        const double p2 = pdf * pdf;
+        return p2 / (p2 + otherPdf * otherPdf);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,641 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <omp.h>
+#include "../Constant.h"
+#include "../Random.h"
+#include "../Vec3.h"
+#include "../Spectrum.h"
+#include "../Sampler.h"
+#include "../Camera.h"
+#include "../Materials/Material.h"
+#include "../Ray.h"
+#include "../BBox.h"
+#include "../Face.h"
+#include "../Sphere.h"
+#include "../Intersect.h"
+#include "../Materials/BSDF.h"
+#include "../Accelerator/KdTree.h"
+#include "../ModelSet.h"
+#include "../Reservoir.h"
+#include "../SDTree.h"
+#include "../PhotonMap.h"
+#include "../IrradianceCache.h"
+#include "../Film.h"
+#include "../Scene.h"
+#include "../Denoiser/Map.h"
+#include "Renderer.h"
+#include "DirectLight.h"
+#include "Transport.h"
+#include "Integrator.h"
+
+using namespace hiraishi;
+
+// Volume properties
+static const double sigma_a = 0.01;                        // absorption coefficient
+static const double sigma_s = 1.0;                         // scattering coefficient
+static const double sigma_t = sigma_a + sigma_s;           // extinction coefficient
+static const double scatterAlbedo = sigma_s / sigma_t;     // scattering albedo
+static const double majorant = 2.0;
+static const double sigma_n = majorant - sigma_t;          // null-collision coefficient
+
+// path guiding
+static const double BSDF_SAMPLING_FRACTION = 0.5; // the rest of the directions follow the guide
+static const int MAX_GUIDE_VERTICES = 32;
+static const double MIN_GUIDED_ROUGHNESS = 0.3; // a guide sample seldom lands in a sharper lobe
+
+// caustic photon map
+static const int CAUSTIC_NEIGHBORS = 50;
+static const double CAUSTIC_RADIUS = 0.02; // farthest photon gathered, of the scene diagonal
+
+// irradiance cache
+static const double CACHE_ERROR = 0.3;    // a of Ward, records are valid up to this error
+static const int CACHE_THETA = 8;         // strata of the hemisphere of a record
+static const int CACHE_PHI = 24;
+static const int CACHE_FIRST_STRIDE = 16; // pixels between the records looked for first
+
+// resampled direct lighting
+static const int RESERVOIR_CANDIDATES = 8;         // light samples streamed at every first hit
+static const int RESERVOIR_NEIGHBORS = 3;          // reservoirs of nearby pixels merged from the last pass
+static const int RESERVOIR_RADIUS = 10;            // pixels
+// candidates a reservoir carries on, of RESERVOIR_CANDIDATES, longer histories leave the 1/M
+// weights noisier on glossy surfaces, where neighbours hardly draw the samples of each other
+static const double RESERVOIR_MAX_HISTORY = 4.0;
+static const double RESERVOIR_MIN_COS = 0.9;       // normals of the shading points sharing reservoirs
+static const double RESERVOIR_MAX_DEPTH = 0.1;     // difference of their distances to the eye, relative
+
+// a light at the front of the surface at pos, facing it and not shadowed, which it can get from a reservoir
+static bool isLightReachable(const Scene* scene, const LightSample& light, const Vec3& pos, const Vec3& normal, Random& rng) {
+    const Vec3 d = light.pos - pos;
+    if (Vec3::dot(normal, d) <= 0.0 || 0.0 <= Vec3::dot(light.normal, d)) return false;
+    return isVisible(scene->intersect(Ray(pos, d), rng), d.length2());
+}
+
+// unshadowed luminance of the light reaching the shading point through the BSDF, the target of the reservoirs
+static double getLightTarget(const LightSample& light, const Intersect& isect, const BSDF& bsdf) {
+    if (!light.mtlPtr) return 0.0;
+    const double dist2 = Vec3::dist2(light.pos, isect.pos);
+    const Vec3 wi = (light.pos - isect.pos).normalize();
+    const double dot1 = Vec3::dot(isect.normal, wi);
+    const double dot2 = Vec3::dot(light.normal, -wi);
+    if (dot1 <= 0.0 || dot2 <= 0.0) return 0.0;
+    double pdf;
+    const Vec3 c = bsdf.evaluateBSDF(wi, pdf) * light.mtlPtr->Ke * (dot1 * dot2 / dist2);
+    return 0.2126 * c.x + 0.7152 * c.y + 0.0722 * c.z;
+}
+
+template <class Transport, int lightSampling, bool isVolume>
+void Renderer_Integrator<Transport, lightSampling, isVolume>::render(const Scene* scene, const Camera* camera, Film* film) {
+    model = &scene->getModel();
+    transport.init();
+
+    reportUnsupported(true, Transport::canStoreRadiance, true, true);
+    isCausticMapped = 0 < numCausticPhotons && Transport::canStoreRadiance && model->hasLights();
+    if (isCausticMapped && (causticScene != scene || causticMapPhotons != numCausticPhotons)) buildCausticMap(scene);
+
+    isIrradianceCached = isIrradianceCaching && Transport::canStoreRadiance;
+    if (isIrradianceCached) {
+        if (cacheScene != scene) irradianceCache.init(model->getBBox(), CACHE_ERROR);
+        cacheScene = scene;
+        fillIrradianceCache(scene, camera, film);
+    }
+
+    isPrimaryCached = 0 < primaryCacheSpp;
+    if (isPrimaryCached) initPrimaryHits(scene, camera, film);
+
+    // the reservoirs outlive the render, a new view keeps the ones whose shading points still match
+    isReservoirSampled = isReservoirSampling && model->hasLights();
+    if (isReservoirSampled && (reservoirScene != scene || reservoirWidth != film->width || reservoirHeight != film->height)) {
+        reservoirs.assign(film->getNumPixels(), Reservoir());
+        reservoirScene = scene;
+        reservoirWidth = film->width;
+        reservoirHeight = film->height;
+    }
+    if (isReservoirSampled) previousReservoirs = reservoirs;
+
+    // the guide is refined after 1, 2, 4, ... spp and guides the paths of the next iteration
+    double guideSpp = 0.0;
+    if (isGuiding) guide.init(model->getBBox());
+
+    const auto start = std::chrono::system_clock::now();
+    std::cout << ">> Render : START" << std::endl;
+    renderPasses(film, Transport::minPassSpp, Transport::canAdapt, Transport::canEstimateError, [&](const int i, const int j, const int numSamples, Random& rng) {
+        renderPixel(scene, camera, film, i, j, numSamples, rng);
+    }, [&]() {
+        if (isReservoirSampled) previousReservoirs = reservoirs;
+        const double spp = film->getAverageSampleCount();
+        if (!isGuiding || spp < guideSpp * 2.0 || spp == 0.0) return;
+        guide.refine(spp - guideSpp);
+        guideSpp = spp;
+    });
+    if (isGuiding) std::cout << ">> Render : Guide " << guide.getNumLeaves() << " leaves" << std::endl;
+
+    const auto end = std::chrono::system_clock::now();
+    const auto duration = end - start;
+    const auto msec = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+    std::cout << std::endl << ">> Render : FINISH" << std::endl
+        << ">> Render : Time " << msec << "msec" << std::endl << std::endl;
+    film->setRenderStatus(msec, (int)(film->getAverageSampleCount() + 0.5));
+}
+
+template <class Transport, int lightSampling, bool isVolume>
+void Renderer_Integrator<Transport, lightSampling, isVolume>::buildCausticMap(const Scene* scene) {
+    const auto start = std::chrono::system_clock::now();
+    const int numPhotons = numCausticPhotons;
+    const BBox bbox = model->getBBox();
+    causticRadius = CAUSTIC_RADIUS * (bbox.max - bbox.min).length();
+
+    // a light path leaves at most one photon, on the first diffuse surface after glass or mirrors,
+    // kept in the order of the paths so the map does not depend on the threads
+    std::vector<PhotonMap::Photon> photons(numPhotons);
+    std::vector<char> isStored(numPhotons, 0);
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (int i = 0; i < numPhotons; i++) {
+        Random rng((uint64_t)i);
+        const LightSample light = model->sampleEmission(rng);
+        if (light.pdf == 0.0) continue;
+        // cosine weighted, the flux of a face is Ke * area * pi
+        const double r = sqrt(rng.next());
+        const double theta = 2.0 * M_PI * rng.next();
+        const Vec3 dirLocal(r * cos(theta), sqrt(fmax(0.0, 1.0 - r * r)), r * sin(theta));
+        Ray ray(light.pos, Vec3::convertVectorRelativeToN(dirLocal, light.normal));
+        Vec3 power = light.mtlPtr->Ke * (M_PI / (light.pdf * numPhotons));
+
+        for (int bounce = 0; bounce <= maxBounce; bounce++) {
+            const Intersect isect = scene->intersect(ray, rng);
+            if (isect.t == H_INFINITE) break;
+            const double cosTerm = Vec3::absDot(ray.d, isect.normal);
+            BSDF bsdf = BSDF(ray, isect, cosTerm);
+            if (!bsdf.isDelta()) {
+                if (0 < bounce && isect.mtlPtr->illum == 2) {
+                    photons[i].pos = isect.pos;
+                    photons[i].wi = -ray.d;
+                    photons[i].power = power;
+                    isStored[i] = 1;
+                }
+                break;
+            }
+            const Vec3 dir = bsdf.evaluateDirection(rng);
+            double pdf = 1.0;
+            const Vec3 fs = bsdf.evaluateBSDF(pdf);
+            power = power * fs * (bsdf.getCosTerm() / pdf);
+            ray = Ray(isect.pos, dir);
+        }
+    }
+
+    std::vector<PhotonMap::Photon> stored;
+    for (int i = 0; i < numPhotons; i++) {
+        if (isStored[i]) stored.push_back(photons[i]);
+    }
+    causticMap.init(stored);
+    causticScene = scene;
+    causticMapPhotons = numPhotons;
+
+    const auto msec = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start).count();
+    std::cout << ">> Photon : " << causticMap.size() << " caustic photons of " << numPhotons << std::endl
+        << ">> Photon : Time " << msec << "msec" << std::endl;
+}
+
+template <class Transport, int lightSampling, bool isVolume>
+void Renderer_Integrator<Transport, lightSampling, isVolume>::fillIrradianceCache(const Scene* scene, const Camera* camera, const Film* film) {
+    const auto start = std::chrono::system_clock::now();
+    const size_t numRecordsBefore = irradianceCache.size();
+    const Vec3& eye = camera->getEye();
+    // coarse to fine over the pixels of the crop window, each level adds records where the ones before leave gaps
+    int x0, y0, x1, y1;
+    film->getCropRect(x0, y0, x1, y1);
+    for (int stride = CACHE_FIRST_STRIDE; 1 <= stride; stride /= 2) {
+        std::vector<int> pixels;
+        for (int j = y0; j < y1; j += stride) {
+            for (int i = x0; i < x1; i += stride) {
+                if (stride < CACHE_FIRST_STRIDE && (i - x0) % (stride * 2) == 0 && (j - y0) % (stride * 2) == 0) continue;
+                pixels.push_back(i + film->width * j);
+            }
+        }
+        std::vector<IrradianceCache::Record> records(pixels.size());
+        std::vector<char> isComputed(pixels.size(), 0);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int n = 0; n < (int)pixels.size(); n++) {
+            const int p = pixels[n];
+            Random rng((uint64_t)p);
+            Sampler sampler(0);
+            const Vec3 target = camera->samplePixel(p % film->width, p / film->width, film->width, film->height, rng, sampler);
+            // the first diffuse surface seen through glass and mirrors
+            Ray ray(eye, target - eye);
+            Intersect isect;
+            for (int bounce = 0; bounce <= maxBounce; bounce++) {
+                isect = scene->intersect(ray, rng);
+                if (isect.t == H_INFINITE) break;
+                BSDF bsdf = BSDF(ray, isect, Vec3::absDot(ray.d, isect.normal));
+                if (!bsdf.isDelta()) break;
+                ray = Ray(isect.pos, bsdf.evaluateDirection(rng));
+                isect.t = H_INFINITE;
+            }
+            if (isect.t == H_INFINITE || isect.mtlPtr->illum != 2) continue;
+            Vec3 irradiance;
+            if (irradianceCache.getIrradiance(isect.pos, isect.normal, irradiance)) continue;
+
+            // a full path from every stratum of the hemisphere
+            std::vector<Vec3> radiances(CACHE_THETA * CACHE_PHI);
+            std::vector<double> distances(CACHE_THETA * CACHE_PHI);
+            for (int k = 0; k < CACHE_THETA * CACHE_PHI; k++) {
+                Random pathRng(((uint64_t)p << 16) + k);
+                const double u1 = pathRng.next();
+                const double u2 = pathRng.next();
+                const Vec3 dir = IrradianceCache::getSampleDirection(isect.normal, k / CACHE_PHI, k % CACHE_PHI, CACHE_THETA, CACHE_PHI, u1, u2);
+                const Ray sampleRay(isect.pos, dir);
+                distances[k] = scene->intersect(sampleRay, pathRng).t;
+                Path path;
+                transport.beginPath(path, pathRng);
+                tracePath(scene, sampleRay, path, pathRng, true);
+                radiances[k] = transport.getRadiance(path);
+            }
+            records[n] = irradianceCache.makeRecord(isect.pos, isect.normal, radiances, distances, CACHE_THETA, CACHE_PHI);
+            isComputed[n] = 1;
+        }
+        // in pixel order, so the cache does not depend on the threads, and only where
+        // the records added before still leave a gap
+        for (size_t n = 0; n < pixels.size(); n++) {
+            Vec3 irradiance;
+            if (isComputed[n] && !irradianceCache.getIrradiance(records[n].pos, records[n].normal, irradiance)) irradianceCache.add(records[n]);
+        }
+    }
+
+    const auto msec = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start).count();
+    std::cout << ">> Cache : " << irradianceCache.size() << " irradiance records, " << irradianceCache.size() - numRecordsBefore << " new" << std::endl
+        << ">> Cache : Time " << msec << "msec" << std::endl;
+}
+
+template <class Transport, int lightSampling, bool isVolume>
+void Renderer_Integrator<Transport, lightSampling, isVolume>::initPrimaryHits(const Scene* scene, const Camera* camera, const Film* film) {
+    const bool isSameView = primaryScene == scene && primaryWidth == film->width && primaryHeight == film->height && primarySpp == primaryCacheSpp
+        && primaryCamera.getEye() == camera->getEye() && primaryCamera.getCenter() == camera->getCenter()
+        && primaryCamera.getFov() == camera->getFov() && primaryCamera.getAspect() == camera->getAspect();
+    if (isSameView) return;
+    primaryHits.assign((size_t)film->getNumPixels() * primaryCacheSpp, PrimaryHit());
+    primaryScene = scene;
+    primaryCamera = *camera;
+    primaryWidth = film->width;
+    primaryHeight = film->height;
+    primarySpp = primaryCacheSpp;
+}
+
+template <class Transport, int lightSampling, bool isVolume>
+void Renderer_Integrator<Transport, lightSampling, isVolume>::renderPixel(const Scene* scene, const Camera* camera, Film* film, const int i, const int j, const int numSamples, Random& rng) {
+    const int p = i + film->width * j;
+    const Vec3& eye = camera->getEye();
+    const int firstSample = film->getSampleCount(p);
+    Sampler sampler(firstSample);
+    Pixel pixel;
+    transport.beginPixel(pixel);
+    bool isNewHit = false;
+    for (int s = 0; s < numSamples; s++) {
+        rng.start(i, j, film->width, firstSample + s);
+        Path path;
+        transport.beginPath(path, rng);
+        if (isPrimaryCached) {
+            // the samples cycle through the first positions of the R2 sequence,
+            // each one is traced through the scene once
+            const int k = (firstSample + s) % primaryCacheSpp;
+            Sampler positionSampler(k);
+            const Vec3 rp = positionSampler.R2Sampler();
+            const Vec3 target = camera->getScreenPoint((i + rp.x) / film->width, (j + rp.y) / film->height);
+            const Ray ray(eye, target - eye);
+            PrimaryHit& hit = primaryHits[(size_t)p * primaryCacheSpp + k];
+            if (hit.faceIndex == -2) {
+                const Intersect isect = scene->intersect(ray, rng);
+                hit.faceIndex = isect.faceIndex;
+                hit.t = isect.t;
+                isNewHit = true;
+            }
+            const Intersect isect = model->getIntersect(ray, hit.faceIndex, hit.t);
+            tracePath(scene, ray, path, rng, false, &isect, isReservoirSampled ? p : -1);
+        }
+        else {
+            // Sample pos on film and generate initial ray
+            const Vec3 target = camera->samplePixel(i, j, film->width, film->height, rng, sampler);
+            tracePath(scene, Ray(eye, target - eye), path, rng, false, NULL, isReservoirSampled ? p : -1);
+        }
+        transport.endPath(pixel, path, film, p);
+    }
+    transport.endPixel(pixel, numSamples, film, p);
+    if (isNewHit && auxMap) setAuxMaps(camera, film, i, j);
+}
+
+template <class Transport, int lightSampling, bool isVolume>
+void Renderer_Integrator<Transport, lightSampling, isVolume>::setAuxMaps(const Camera* camera, const Film* film, const int i, const int j) const {
+    const int p = i + film->width * j;
+    const Vec3& eye = camera->getEye();
+    Vec3 normal, albedo;
+    double depth = 0.0;
+    int numHits = 0;
+    for (int k = 0; k < primaryCacheSpp; k++) {
+        const PrimaryHit& hit = primaryHits[(size_t)p * primaryCacheSpp + k];
+        if (hit.faceIndex < 0) continue;
+        Sampler positionSampler(k);
+        const Vec3 rp = positionSampler.R2Sampler();
+        const Vec3 target = camera->getScreenPoint((i + rp.x) / film->width, (j + rp.y) / film->height);
+        const Intersect isect = model->getIntersect(Ray(eye, target - eye), hit.faceIndex, hit.t);
+        normal = normal + isect.normal;
+        albedo = albedo + isect.mtlPtr->Kd;
+        depth += isect.t;
+        numHits++;
+    }
+    if (numHits == 0) return;
+    auxMap->setNormal(normal / numHits, p);
+    auxMap->setDepth(depth / numHits, p);
+    auxMap->setAlbedo(albedo / numHits, p);
+}
+
+template <class Transport, int lightSampling, bool isVolume>
+LightSample Renderer_Integrator<Transport, lightSampling, isVolume>::resampleLight(const Scene* scene, const Intersect& isect, const BSDF& bsdf, const Vec3& eye, const int p, Random& rng) {
+    // candidates from the light list
+    Reservoir reservoir;
+    reservoir.pos = isect.pos;
+    reservoir.normal = isect.normal;
+    reservoir.mtlPtr = isect.mtlPtr;
+    for (int c = 0; c < RESERVOIR_CANDIDATES; c++) {
+        rng.setDimension(Random::DIM_RESERVOIR + c * 4);
+        const LightSample light = model->sampleLight(isect.pos, isect.normal, rng);
+        const double target = (0.0 < light.pdf) ? getLightTarget(light, isect, bsdf) : 0.0;
+        reservoir.update(light, target, (0.0 < target) ? target / light.pdf : 0.0, rng.next());
+    }
+
+    // the reservoir of the samples before in this pixel, then the ones of nearby pixels
+    // as the last pass left them, where the shading points are alike
+    const Reservoir* merged[RESERVOIR_NEIGHBORS + 1];
+    double mergedCandidates[RESERVOIR_NEIGHBORS + 1];
+    int numMerged = 0;
+    const double depth = (isect.pos - eye).length();
+    const double maxHistory = RESERVOIR_MAX_HISTORY * RESERVOIR_CANDIDATES;
+    const int x = p % reservoirWidth;
+    const int y = p / reservoirWidth;
+    for (int n = 0; n <= RESERVOIR_NEIGHBORS; n++) {
+        rng.setDimension(Random::DIM_RESERVOIR + (RESERVOIR_CANDIDATES + n) * 4);
+        int q = p;
+        if (0 < n) {
+            const int nx = x + (int)((rng.next() * 2.0 - 1.0) * RESERVOIR_RADIUS);
+            const int ny = y + (int)((rng.next() * 2.0 - 1.0) * RESERVOIR_RADIUS);
+            if (nx < 0 || reservoirWidth <= nx || ny < 0 || reservoirHeight <= ny || (nx == x && ny == y)) continue;
+            q = nx + reservoirWidth * ny;
+        }
+        const Reservoir& other = (n == 0) ? reservoirs[q] : previousReservoirs[q];
+        if (other.numCandidates == 0.0 || other.mtlPtr != isect.mtlPtr || Vec3::dot(other.normal, isect.normal) < RESERVOIR_MIN_COS
+            || RESERVOIR_MAX_DEPTH * depth < fabs((other.pos - eye).length() - depth)) continue;
+        // an old sample stays for at most as many candidates as the history holds
+        Reservoir capped = other;
+        if (maxHistory < capped.numCandidates) capped.numCandidates = maxHistory;
+        reservoir.merge(capped, getLightTarget(other.sample, isect, bsdf), rng.next());
+        merged[numMerged] = &other;
+        mergedCandidates[numMerged++] = capped.numCandidates;
+    }
+    // 1/M weights over the shading points that could have drawn the sample, a neighbour behind
+    // an occluder counts none of its candidates, the shadow test here covers the own ones
+    double numSupporting = RESERVOIR_CANDIDATES;
+    for (int m = 0; m < numMerged; m++) {
+        if (isLightReachable(scene, reservoir.sample, merged[m]->pos, merged[m]->normal, rng)) numSupporting += mergedCandidates[m];
+    }
+    reservoir.finish(numSupporting);
+    reservoirs[p] = reservoir;
+
+    LightSample light = reservoir.sample;
+    if (reservoir.W <= 0.0) return LightSample();
+    light.pdf = 1.0 / reservoir.W;
+    return light;
+}
+
+template <class Transport, int lightSampling, bool isVolume>
+void Renderer_Integrator<Transport, lightSampling, isVolume>::tracePath(const Scene* scene, Ray ray, Path& path, Random& rng, const bool isFromCache, const Intersect* primaryHit, const int pixel) {
+    // surface vertices whose outgoing direction teaches the guide the light that came back along it
+    struct GuideVertex {
+        Vec3 pos;
+        Vec3 dir;
+        double pdf;
+        Path path; // after the BSDF was applied
+    };
+    GuideVertex guideVertices[MAX_GUIDE_VERTICES];
+    int numGuideVertices = 0;
+
+    int bounce = 0;
+    // a guided sample toward the light has a low throughput, the roulette must not kill it for that
+    double rouletteScale = 1.0;
+    // with the caustic map, light reaching a diffuse vertex through glass or mirrors only is
+    // gathered there, and the path must not find it again
+    // the vertex of a cache record gathers its own caustics
+    bool isGathered = isFromCache; // the last vertex that was not glass or a mirror was diffuse
+    bool isCausticTail = false;    // and glass or mirrors followed it
+    // the first diffuse vertex seen through glass and mirrors takes the cached interreflection
+    bool isCacheable = isIrradianceCached && !isFromCache;
+    bool isLightSampled = false; // the light was sampled at the previous vertex
+    bool isLightResampled = false; // from the reservoir, which is not weighted against the emission
+    double bsdfPdf = 0.0;        // solid angle pdf of the ray leaving the previous vertex
+    Vec3 previousNormal;         // the previous vertex is ray.o
+    bool isInVolume = false;
+    // free flights draw after the dimensions of every bounce
+    uint32_t volumeDimension = Random::DIM_BOUNCE + (maxBounce + 2) * Random::DIMS_PER_BOUNCE;
+
+    // Main Rendering Loop
+    while (true) {
+        // Intersect with model
+        const Intersect isect = primaryHit ? *primaryHit : scene->intersect(ray, rng);
+        primaryHit = NULL;
+        if (isect.t == H_INFINITE) break;
+
+        if (isVolume && isect.mtlPtr->illum == H_MTL_VOLUME) isInVolume = true;
+        if (isVolume && isInVolume) {
+            // Free tracking, sample scatter distance
+            rng.setDimension(volumeDimension);
+            volumeDimension += 8;
+            const double v_t = -log(1.0 - rng.next()) / sigma_t;
+            isLightSampled = false;
+            isGathered = isCausticTail = false; // the photons never enter the medium
+            isCacheable = false;                // nor do the records
+
+            if (isect.t < v_t) {
+                // pass through the boundary and leave the medium
+                const double cosTerm = Vec3::absDot(ray.d, isect.normal);
+                BSDF bsdf = BSDF(ray, isect, cosTerm);
+                transport.applyBSDF(path, bsdf, isect);
+                ray = Ray(isect.pos, ray.d);
+                // Add Le
+                if (isect.mtlPtr->Ke != Vec3::black()) {
+                    transport.addEmission(path, isect.mtlPtr, 1.0);
+                }
+                if (!continuePath(path, bounce, rng)) break;
+
+                isInVolume = false;
+                bounce++;
+                continue;
+            }
+
+            // update ray
+            ray.o = ray.o + ray.d * v_t;
+
+            if (rng.next() < sigma_a / majorant) { // absorption or emission collision
+                transport.multiplyThroughput(path, 0.97);
+                break;
+            }
+            else if (rng.next() < 1.0 - sigma_n / majorant) { // scattering collision
+                ray.d = BSDF::randomDirSphere(rng);
+                transport.multiplyThroughput(path, exp(-sigma_t * v_t));
+            }
+
+            // Russian Roulette
+            if (scatterAlbedo < rng.next()) break;
+            continue;
+        }
+
+        // Add Le, weighted against the light sample of the previous vertex
+        // a cache record samples the lights itself
+        if (isect.mtlPtr->Ke != Vec3::black() && !isCausticTail && !(isFromCache && bounce == 0)) {
+            if (!isLightSampled) {
+                transport.addEmission(path, isect.mtlPtr, 1.0);
+            }
+            else if (lightSampling == H_LIGHT_MIS && !isLightResampled) {
+                const double cosLight = Vec3::dot(isect.normal, -ray.d);
+                const double lightPdf = (0.0 < cosLight) ? model->getLightPdf(ray.o, previousNormal, isect) * isect.t * isect.t / cosLight : 0.0;
+                transport.addEmission(path, isect.mtlPtr, powerHeuristic(bsdfPdf, lightPdf));
+            }
+        }
+
+        const double cosTerm = Vec3::absDot(ray.d, isect.normal);
+        BSDF bsdf = BSDF(ray, isect, cosTerm);
+        Vec3 cachedIrradiance;
+        const bool isCached = isCacheable && isect.mtlPtr->illum == 2 && irradianceCache.getIrradiance(isect.pos, isect.normal, cachedIrradiance);
+        if (!bsdf.isDelta()) isCacheable = false;
+        // the records, the cached vertices, where the path ends, and the first hits with a
+        // reservoir sample the lights in any renderer
+        isLightResampled = 0 <= pixel && bounce == 0 && !bsdf.isDelta();
+        isLightSampled = (lightSampling != H_LIGHT_BSDF || isFromCache || isCached || isLightResampled) && model->hasLights() && !bsdf.isDelta();
+        const bool isGuided = isGuiding && bsdf.isSmooth() && guide.canSample()
+            && (bsdf.getMaterial()->illum == 2 || MIN_GUIDED_ROUGHNESS <= bsdf.getMaterial()->roughness);
+
+        if (isCausticMapped) {
+            if (isect.mtlPtr->illum == 2) {
+                const Vec3 irradiance = causticMap.getIrradiance(isect.pos, isect.normal, CAUSTIC_NEIGHBORS, causticRadius);
+                transport.addRadiance(path, isect.mtlPtr->Kd * irradiance / M_PI);
+                isGathered = true;
+                isCausticTail = false;
+            }
+            else if (bsdf.isDelta()) {
+                isCausticTail = isGathered;
+            }
+            else {
+                isGathered = isCausticTail = false;
+            }
+        }
+
+        // NEE
+        if (isLightSampled) {
+            LightSample light;
+            if (isLightResampled) {
+                light = resampleLight(scene, isect, bsdf, ray.o, pixel, rng);
+            }
+            else {
+                rng.setDimension(bounce, Random::DIM_LIGHT);
+                light = model->sampleLight(isect.pos, isect.normal, rng);
+            }
+            const Ray shadowRay(isect.pos, light.pos - isect.pos);
+            const double dot1 = Vec3::dot(isect.normal, shadowRay.d);
+            const double dot2 = Vec3::dot(light.normal, -shadowRay.d);
+            if (0.0 < dot1 && 0.0 < dot2) {
+                const double dist2 = Vec3::dist2(light.pos, isect.pos);
+                const Intersect shadowIsect = scene->intersect(shadowRay, rng);
+                if (isVisible(shadowIsect, dist2)) {
+                    const double G = dot1 * dot2 / dist2;
+                    double weight = 1.0;
+                    if (lightSampling == H_LIGHT_MIS && !isCached && !isLightResampled) {
+                        // both pdfs per solid angle at the shading point
+                        double pdf;
+                        bsdf.evaluateBSDF(shadowRay.d, pdf);
+                        if (isGuided) pdf = BSDF_SAMPLING_FRACTION * pdf + (1.0 - BSDF_SAMPLING_FRACTION) * guide.getPdf(isect.pos, bsdf.getReflectionNormal(), shadowRay.d);
+                        weight = powerHeuristic(light.pdf * dist2 / dot2, pdf);
+                    }
+                    transport.addDirect(path, light.mtlPtr, bsdf, shadowRay.d, weight * G / light.pdf);
+                }
+                // a shadowed sample is not passed on, neighbours count a reservoir only where its sample is lit
+                else if (isLightResampled) {
+                    reservoirs[pixel].W = 0.0;
+                }
+            }
+        }
+
+        if (isCached) {
+            transport.addRadiance(path, isect.mtlPtr->Kd * cachedIrradiance / M_PI);
+            break;
+        }
+
+        // Set next ray and update throughput
+        Vec3 dir;
+        double pdf = 0.0; // of dir, only kept for guiding
+        if (isGuided) {
+            // one sample model over the BSDF and the guide
+            rng.setDimension(bounce, Random::DIM_GUIDE);
+            const bool isGuideSampled = BSDF_SAMPLING_FRACTION <= rng.next();
+            rng.setDimension(bounce, Random::DIM_BSDF);
+            if (isGuideSampled) {
+                const double u1 = rng.next();
+                const double u2 = rng.next();
+                dir = guide.sample(isect.pos, bsdf.getReflectionNormal(), u1, u2);
+                bsdf.setDirection(dir);
+            }
+            else {
+                dir = bsdf.evaluateDirection(rng);
+            }
+            double bsdfDirPdf;
+            bsdf.evaluateBSDF(dir, bsdfDirPdf);
+            pdf = BSDF_SAMPLING_FRACTION * bsdfDirPdf + (1.0 - BSDF_SAMPLING_FRACTION) * guide.getPdf(isect.pos, bsdf.getReflectionNormal(), dir);
+            if (pdf == 0.0) break;
+            transport.applyBSDF(path, bsdf, dir, pdf);
+            if (0.0 < bsdfDirPdf) rouletteScale *= pdf / bsdfDirPdf;
+        }
+        else {
+            rng.setDimension(bounce, Random::DIM_BSDF);
+            dir = bsdf.evaluateDirection(rng);
+            transport.applyBSDF(path, bsdf, isect);
+            if (isGuiding && bsdf.isSmooth()) bsdf.evaluateBSDF(dir, pdf);
+        }
+        ray = Ray(isect.pos, dir);
+        if (lightSampling == H_LIGHT_MIS && isLightSampled) {
+            if (isGuided) bsdfPdf = pdf;
+            else bsdf.evaluateBSDF(dir, bsdfPdf);
+            previousNormal = isect.normal;
+        }
+        if (0.0 < pdf && numGuideVertices < MAX_GUIDE_VERTICES) {
+            guideVertices[numGuideVertices++] = { isect.pos, dir, pdf, path };
+        }
+
+        if (!continuePath(path, bounce, rng, rouletteScale)) break;
+        bounce++;
+    }
+
+    for (int v = 0; v < numGuideVertices; v++) {
+        const GuideVertex& vertex = guideVertices[v];
+        guide.record(vertex.pos, vertex.dir, transport.getIncidentRadiance(path, vertex.path) / vertex.pdf);
+    }
+}
+
+template <class Transport, int lightSampling, bool isVolume>
+bool Renderer_Integrator<Transport, lightSampling, isVolume>::continuePath(Path& path, const int bounce, Random& rng, const double rouletteScale) const {
+    // Russian Roulette, a glossy sample can raise the throughput above 1
+    const double prob = fmin(1.0, transport.maxThroughput(path) * rouletteScale);
+    if (prob == 0) return false;
+    rng.setDimension(bounce, Random::DIM_ROULETTE);
+    if (prob < rng.next() || maxBounce < bounce) return false;
+    transport.divideThroughput(path, prob);
+    return true;
+}
+
+// every combination of the policies
+template class Renderer_Integrator<RGBTransport, H_LIGHT_BSDF, false>;
+template class Renderer_Integrator<RGBTransport, H_LIGHT_NEE, false>;
+template class Renderer_Integrator<RGBTransport, H_LIGHT_MIS, false>;
+template class Renderer_Integrator<RGBTransport, H_LIGHT_BSDF, true>;
+template class Renderer_Integrator<RGBTransport, H_LIGHT_NEE, true>;
+template class Renderer_Integrator<RGBTransport, H_LIGHT_MIS, true>;
+template class Renderer_Integrator<SpectralTransport, H_LIGHT_BSDF, false>;
+template class Renderer_Integrator<SpectralTransport, H_LIGHT_NEE, false>;
+template class Renderer_Integrator<SpectralTransport, H_LIGHT_MIS, false>;
+template class Renderer_Integrator<SpectralTransport, H_LIGHT_BSDF, true>;
+template class Renderer_Integrator<SpectralTransport, H_LIGHT_NEE, true>;
+template class Renderer_Integrator<SpectralTransport, H_LIGHT_MIS, true>;
\ No newline at end of file
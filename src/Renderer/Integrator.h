@@ -0,0 +1,79 @@
+#pragma once
+
+namespace hiraishi {
+    // Path tracer shared by all light transport variants.
+    // Transport is the radiance representation (RGBTransport or SpectralTransport),
+    // lightSampling is one of H_LIGHT_BSDF, H_LIGHT_NEE and H_LIGHT_MIS, and isVolume traces
+    // the homogeneous medium behind illum 11 surfaces. Each combination is compiled as its
+    // own kernel, the flags are constants in the path loop.
+    template <class Transport, int lightSampling, bool isVolume>
+    class Renderer_Integrator : public Renderer {
+    private:
+        typedef typename Transport::Path Path;
+        typedef typename Transport::Pixel Pixel;
+
+        const ModelSet* model = NULL; // the scene's, a batch renders many frames of it
+        Transport transport;
+        SDTree guide;
+        // kept while the scene and the number of photons stay, so moving the camera reuses it
+        PhotonMap causticMap;
+        const Scene* causticScene = NULL;
+        int causticMapPhotons = 0;
+        bool isCausticMapped = false;
+        double causticRadius = 0.0;
+        // kept while the scene stays, a new view only adds the records it lacks
+        IrradianceCache irradianceCache;
+        const Scene* cacheScene = NULL;
+        bool isIrradianceCached = false;
+        // first hit of every cached sub-pixel position, kept while the camera and the scene stay
+        struct PrimaryHit {
+            int faceIndex = -2; // -1 : missed, -2 : not traced yet
+            double t = H_INFINITE;
+        };
+        std::vector<PrimaryHit> primaryHits;
+        const Scene* primaryScene = NULL;
+        Camera primaryCamera;
+        int primaryWidth = 0;
+        int primaryHeight = 0;
+        int primarySpp = 0;
+        bool isPrimaryCached = false;
+        // reservoir of every pixel, and all of them as the last pass left them for the neighbours
+        std::vector<Reservoir> reservoirs;
+        std::vector<Reservoir> previousReservoirs;
+        const Scene* reservoirScene = NULL;
+        int reservoirWidth = 0;
+        int reservoirHeight = 0;
+        bool isReservoirSampled = false;
+
+        void buildCausticMap(const Scene* scene);
+        void fillIrradianceCache(const Scene* scene, const Camera* camera, const Film* film);
+        void initPrimaryHits(const Scene* scene, const Camera* camera, const Film* film);
+        void renderPixel(const Scene* scene, const Camera* camera, Film* film, const int i, const int j, const int numSamples, Random& rng);
+        // averages the cached first hits of the pixel into the aux maps
+        void setAuxMaps(const Camera* camera, const Film* film, const int i, const int j) const;
+        // light for the first hit of pixel p out of its reservoir, merged with the ones of the
+        // samples before and of nearby pixels, its pdf is the inverse of the reservoir weight
+        LightSample resampleLight(const Scene* scene, const Intersect& isect, const BSDF& bsdf, const Vec3& eye, const int p, Random& rng);
+        // isFromCache : the ray leaves the vertex of an irradiance cache record, whose light is sampled there
+        // primaryHit : the first hit of ray, already known
+        // pixel : whose reservoir gives the light of the first hit, -1 : none
+        void tracePath(const Scene* scene, Ray ray, Path& path, Random& rng, const bool isFromCache = false, const Intersect* primaryHit = NULL, const int pixel = -1);
+        // rouletteScale turns the throughput into the one BSDF sampling would have given
+        bool continuePath(Path& path, const int bounce, Random& rng, const double rouletteScale = 1.0) const;
+
+    public:
+        Renderer_Integrator() {}
+        Renderer_Integrator(const ModelSet& model_) {
+            model = &model_;
+        }
+        ~Renderer_Integrator() {}
+
+        void render(const Scene* scene, const Camera* camera, Film* film);
+    };
+
+    typedef Renderer_Integrator<RGBTransport, H_LIGHT_BSDF, false> Renderer_PT;
+    typedef Renderer_Integrator<RGBTransport, H_LIGHT_NEE, false> Renderer_NEE;
+    typedef Renderer_Integrator<RGBTransport, H_LIGHT_MIS, false> Renderer_MIS;
+    typedef Renderer_Integrator<RGBTransport, H_LIGHT_BSDF, true> Renderer_PT_Volume;
+    typedef Renderer_Integrator<SpectralTransport, H_LIGHT_BSDF, false> Renderer_SingleSpectrum_PT;
+}
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include <iostream>
+#include <stdio.h>
+#include <math.h>
+#include <omp.h>
+#include "../Random.h"
+#include "../Vec3.h"
+#include "../Film.h"
+#include "Renderer.h"
+#include "TileScheduler.h"
+
+using namespace hiraishi;
+
+// block side of the coarsest multi-resolution preview, halved down to 2
+static const int MAX_PREVIEW_STRIDE = 8;
+
+bool Renderer::isOver() const {
+    if (isStopRequested) return true;
+    if (timeBudget <= 0.0) return false;
+    return timeBudget <= std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+}
+
+void Renderer::renderPasses(Film* film, const int minPassSpp, const bool canAdapt, const bool canEstimateError, const PixelFunc& renderPixel, const PassFunc& endPass) {
+    const int width = film->width;
+    renderPasses(film, minPassSpp, canAdapt, canEstimateError, [&](const RenderTile& tile, const int numSamples, const std::vector<char>* mask, Random& rng) {
+        for (int j = tile.y0; j < tile.y1; j++) {
+            for (int i = tile.x0; i < tile.x1; i++) {
+                if (mask && !(*mask)[i + width * j]) continue;
+                renderPixel(i, j, numSamples, rng);
+            }
+        }
+    }, endPass);
+}
+
+void Renderer::renderPasses(Film* film, const int minPassSpp, const bool canAdapt, const bool canEstimateError, const TileFunc& renderTile, const PassFunc& endPass, const EndTilesFunc& endTiles) {
+    renderStart = std::chrono::steady_clock::now();
+    if (isAdaptive && !canAdapt) std::cout << ">> Render : Adaptive sampling is not supported by this renderer" << std::endl;
+    if (isErrorTarget && !canEstimateError) std::cout << ">> Render : Error target is not supported by this renderer" << std::endl;
+    const bool isAdaptiveRun = isAdaptive && canAdapt;
+    const bool isErrorTargetRun = isErrorTarget && canEstimateError;
+    const bool isErrorChecked = isAdaptiveRun || isErrorTargetRun;
+    // spp is the budget unless the render is ended by time or by error
+    const bool isSppBudget = timeBudget <= 0.0 && !isErrorTargetRun;
+    const int numPixels = film->getNumCropPixels();
+    const long long budget = (long long)spp * numPixels;
+    const int numPassSpp = passSpp < minPassSpp ? minPassSpp : (passSpp < 1 ? 1 : passSpp);
+
+    // the error estimate needs a few samples in every pixel first
+    int numSamples = numPassSpp;
+    if (isErrorChecked && numSamples < baseSpp) numSamples = baseSpp < 2 ? 2 : baseSpp;
+    if (isSppBudget && spp < numSamples) numSamples = spp;
+
+    if (isMultiResolution && !canAdapt) std::cout << ">> Render : Multi-resolution preview is not supported by this renderer" << std::endl;
+    if (isMultiResolution && canAdapt) renderPreviews(film, renderTile, endTiles);
+
+    std::vector<char> mask(film->getNumPixels(), 1);
+    int numActive = numPixels;
+    long long numSpent = 0;
+    while (0 < numSamples && !isOver()) {
+        const long long numPassSamples = (long long)numSamples * numActive;
+        // per tile progress only when the end is known
+        const int progressBegin = isSppBudget ? (int)(numSpent * 100 / budget) : 0;
+        const int progressEnd = isSppBudget ? (int)((numSpent + numPassSamples) * 100 / budget) : 0;
+        renderPass(film, numSamples, isAdaptiveRun ? &mask : NULL, progressBegin, progressEnd, renderTile, endTiles);
+        numSpent += numPassSamples;
+        if (endPass) endPass();
+        if (!isSppBudget) fprintf(stderr, ">> Render : %.1f spp\r", film->getAverageSampleCount());
+
+        if (isErrorChecked) {
+            numActive = findNoisyPixels(film, mask);
+            if (numActive == 0) break;
+            if (!isAdaptiveRun) numActive = numPixels;
+        }
+        numSamples = numPassSpp;
+        // spread the rest of the budget, a pass never goes over it
+        if (isSppBudget && (budget - numSpent) / numActive < numSamples) numSamples = (int)((budget - numSpent) / numActive);
+    }
+
+    std::cout << std::endl << ">> Render : Samples average " << film->getAverageSampleCount() << " spp, min " << film->getMinSampleCount() << " spp" << std::endl;
+    if (isErrorChecked) std::cout << ">> Render : " << numActive << " pixels in tiles above target error" << std::endl;
+}
+
+void Renderer::reportUnsupported(const bool canGuide, const bool canStoreRadiance, const bool canCachePrimary, const bool canResample) const {
+    if (isGuiding && !canGuide) std::cout << ">> Render : Path guiding is not supported by this renderer" << std::endl;
+    if (0 < numCausticPhotons && !canStoreRadiance) std::cout << ">> Render : Caustic photons are not supported by this renderer" << std::endl;
+    if (isIrradianceCaching && !canStoreRadiance) std::cout << ">> Render : Irradiance cache is not supported by this renderer" << std::endl;
+    if (0 < primaryCacheSpp && !canCachePrimary) std::cout << ">> Render : Primary hit cache is not supported by this renderer" << std::endl;
+    if (isReservoirSampling && !canResample) std::cout << ">> Render : Reservoir sampling is not supported by this renderer" << std::endl;
+}
+
+int Renderer::findNoisyPixels(const Film* film, std::vector<char>& mask) const {
+    // Decided per tile from the RMS of the relative pixel errors. A pixel deciding on its
+    // own samples stops right after a lucky run, which biases it. Pixels that have seen
+    // nothing yet have no variance and are left out instead of counting as converged.
+    const int size = tileSize < 1 ? 1 : tileSize;
+    int cropX0, cropY0, cropX1, cropY1;
+    film->getCropRect(cropX0, cropY0, cropX1, cropY1);
+    int numActive = 0;
+    for (int y0 = cropY0; y0 < cropY1; y0 += size) {
+        for (int x0 = cropX0; x0 < cropX1; x0 += size) {
+            const int x1 = x0 + size < cropX1 ? x0 + size : cropX1;
+            const int y1 = y0 + size < cropY1 ? y0 + size : cropY1;
+            int numLit = 0;
+            double sumError2 = 0.0;
+            for (int j = y0; j < y1; j++) {
+                for (int i = x0; i < x1; i++) {
+                    const int p = i + film->width * j;
+                    const double mean = film->getLuminanceMean(p);
+                    if (mean <= 0.0) continue;
+                    // squared standard error of the mean, relative to the mean
+                    sumError2 += film->getLuminanceVariance(p) / film->getSampleCount(p) / (mean * mean);
+                    numLit++;
+                }
+            }
+            const bool isNoisy = 0 < numLit && targetError < sqrt(sumError2 / numLit);
+            for (int j = y0; j < y1; j++) {
+                for (int i = x0; i < x1; i++) {
+                    mask[i + film->width * j] = isNoisy;
+                }
+            }
+            if (isNoisy) numActive += (x1 - x0) * (y1 - y0);
+        }
+    }
+    return numActive;
+}
+
+void Renderer::renderPass(Film* film, const int numSamples, const std::vector<char>* mask, const int progressBegin, const int progressEnd, const TileFunc& renderTile, const EndTilesFunc& endTiles) {
+    RenderTile region;
+    film->getCropRect(region.x0, region.y0, region.x1, region.y1);
+    TileScheduler scheduler(region, tileSize, omp_get_max_threads());
+    scheduler.setProgressRange(progressBegin, progressEnd);
+
+    const float* blueNoise = isBlueNoise ? BlueNoise::getTile() : nullptr;
+#pragma omp parallel
+    {
+        // the renderers start a stream per sample, so nothing depends on the thread
+        Random rng;
+        rng.isSobol = isSobol;
+        rng.blueNoise = blueNoise;
+        TileScheduler::Tile tile;
+        while (!isOver() && scheduler.next(omp_get_thread_num(), tile)) {
+            renderTile(tile, numSamples, mask, rng);
+            scheduler.finish(tile);
+        }
+        // also after a stop, the tiles held back are small next to a pass
+        if (endTiles) endTiles();
+    }
+}
+
+void Renderer::renderPreviews(Film* film, const TileFunc& renderTile, const EndTilesFunc& endTiles) {
+    // Each level renders one sample in the pixels on its grid that the coarser levels left out.
+    // Such a pixel is shown over the block it stands for, until the pixels there get samples of their own.
+    int x0, y0, x1, y1;
+    film->getCropRect(x0, y0, x1, y1);
+    std::vector<char> mask(film->getNumPixels(), 0);
+    std::vector<int> pixels;
+    for (int stride = MAX_PREVIEW_STRIDE; 2 <= stride && !isOver(); stride /= 2) {
+        pixels.clear();
+        for (int j = y0; j < y1; j += stride) {
+            for (int i = x0; i < x1; i += stride) {
+                const int p = i + film->width * j;
+                if (film->getSampleCount(p) == 0) pixels.push_back(p);
+            }
+        }
+        for (const int p : pixels) mask[p] = 1;
+        renderPass(film, 1, &mask, 0, 0, renderTile, endTiles);
+        for (const int p : pixels) {
+            mask[p] = 0;
+            if (film->getSampleCount(p) == 0) continue; // stopped before it
+            const Vec3 c = film->getAverage(p);
+            const int i0 = p % film->width;
+            const int j0 = p / film->width;
+            for (int j = j0; j < j0 + stride && j < y1; j++) {
+                for (int i = i0; i < i0 + stride && i < x1; i++) {
+                    const int q = i + film->width * j;
+                    if (film->getSampleCount(q) == 0) film->setPixelColor(c, q);
+                }
+            }
+        }
+    }
+}
\ No newline at end of file
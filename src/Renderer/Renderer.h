@@ -1,13 +1,84 @@
 #pragma once
 
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <chrono>
+
 namespace hiraishi {
+    class Film;
+    class Map;
+    struct Random;
+    struct RenderTile;
+
     class Renderer {
+    public:
+        typedef std::function<void(const int i, const int j, const int numSamples, Random& rng)> PixelFunc;
+        // renders numSamples in every pixel of the tile that is in mask (all if mask is NULL)
+        typedef std::function<void(const RenderTile& tile, const int numSamples, const std::vector<char>* mask, Random& rng)> TileFunc;
+        // called between passes, when no thread is rendering
+        typedef std::function<void()> PassFunc;
+        // called by each render thread after its last tile of a pass, for a renderer that holds
+        // tiles back to render several of them together
+        typedef std::function<void()> EndTilesFunc;
+
     private:
+        std::atomic<bool> isStopRequested;
+        std::chrono::steady_clock::time_point renderStart;
+
+        bool isOver() const; // stopped or out of time
+
+        // one pass over the film tiles, pixels not in mask (if given) are skipped
+        void renderPass(Film* film, const int numSamples, const std::vector<char>* mask, const int progressBegin, const int progressEnd, const TileFunc& renderTile, const EndTilesFunc& endTiles);
+        int findNoisyPixels(const Film* film, std::vector<char>& mask) const;
+        // 1/8, 1/4 and 1/2 resolution passes before the first full one
+        void renderPreviews(Film* film, const TileFunc& renderTile, const EndTilesFunc& endTiles);
+
+    protected:
+        // adds samples to the film in passes of passSpp samples until spp, the time budget
+        // or the target error is reached, the film is valid after each pixel so stop() can end it at any time
+        // canEstimateError : the film gets the per sample luminance statistics the error is estimated from
+        void renderPasses(Film* film, const int minPassSpp, const bool canAdapt, const bool canEstimateError, const PixelFunc& renderPixel, const PassFunc& endPass = PassFunc());
+        void renderPasses(Film* film, const int minPassSpp, const bool canAdapt, const bool canEstimateError, const TileFunc& renderTile, const PassFunc& endPass = PassFunc(), const EndTilesFunc& endTiles = EndTilesFunc());
+        // reports the options set below that the renderer does not have, they are ignored
+        // canStoreRadiance : caustic photons and the irradiance cache, which add radiance to a path
+        void reportUnsupported(const bool canGuide, const bool canStoreRadiance, const bool canCachePrimary, const bool canResample) const;
+
     public:
-        Renderer() {}
+        Renderer() : isStopRequested(false) {}
         ~Renderer() {}
 
         int spp = 1;
         int maxBounce = 15;
+        int tileSize = 16; // side of the square tiles handed to threads
+        int passSpp = 1;   // samples per pixel added in one progressive pass
+        // the film is shown at 1/8, 1/4 and 1/2 resolution before the full passes, the samples of
+        // those levels stay in the film so a quarter of the pixels gets one more
+        bool isMultiResolution = false;
+        bool isSobol = false; // Owen scrambled Sobol points instead of independent random numbers
+        bool isBlueNoise = false; // neighbouring pixels decorrelated by a blue noise tile, for low spp previews
+        bool isGuiding = false;   // path guiding, learnt while the passes are rendered
+        int numCausticPhotons = 0; // photons traced through glass and mirrors for the caustics, 0 : none
+        bool isIrradianceCaching = false; // diffuse interreflection interpolated between sparse records, for previews
+        // sub-pixel positions whose first hits are kept while the camera stays, the samples
+        // cycle through them instead of tracing new camera rays, 0 : none
+        int primaryCacheSpp = 0;
+        Map* auxMap = NULL; // normal, depth and albedo of the cached first hits, if given
+        // direct light of the first hits resampled from reservoirs of light samples that are
+        // reused across neighbouring pixels and passes (ReSTIR), slightly biased
+        bool isReservoirSampling = false;
+        // adaptive sampling : spp is the average budget, after baseSpp samples
+        // only tiles whose relative error is above targetError get more
+        bool isAdaptive = false;
+        int baseSpp = 16;
+        double targetError = 0.02;
+        // end conditions used instead of spp
+        double timeBudget = 0.0;    // seconds of rendering, 0 : not limited
+        bool isErrorTarget = false; // until every tile is below targetError
+
+        // a stop stays requested until resetStop, which the caller runs before starting the
+        // render thread so that a stop right after the start is not lost
+        void stop() { isStopRequested = true; }
+        void resetStop() { isStopRequested = false; }
     };
 }
\ No newline at end of file
@@ -0,0 +1,335 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <omp.h>
+#include "../Constant.h"
+#include "../Random.h"
+#include "../Vec3.h"
+#include "../Spectrum.h"
+#include "../Sampler.h"
+#include "../Camera.h"
+#include "../Materials/Material.h"
+#include "../Ray.h"
+#include "../BBox.h"
+#include "../Face.h"
+#include "../Sphere.h"
+#include "../Intersect.h"
+#include "../Materials/BSDF.h"
+#include "../Accelerator/KdTree.h"
+#include "../ModelSet.h"
+#include "../Film.h"
+#include "../Scene.h"
+#include "Renderer.h"
+#include "DirectLight.h"
+#include "Renderer_BDPT.h"
+
+using namespace hiraishi;
+
+// a vertex whose pdf is 0 (after a mirror or glass) drops out of the ratios
+static double remap0(const double pdf) {
+    return pdf != 0.0 ? pdf : 1.0;
+}
+
+static double maxComponent(const Vec3& v) {
+    return fmax(v.x, fmax(v.y, v.z));
+}
+
+// only diffuse and glossy surfaces can be reached by a connection
+template <class Vertex>
+static bool isConnectible(const Vertex& v) {
+    if (v.type != Vertex::SURFACE) return true;
+    const int illum = v.isect.mtlPtr->illum;
+    return !v.isDelta && (illum == 2 || illum == 5);
+}
+
+// fs of a surface vertex toward dir, for the direction it was reached from
+template <class Vertex>
+static Vec3 evaluateBSDF(const Vertex& v, const Vec3& dir) {
+    const BSDF bsdf(v.ray, v.isect, 0.0);
+    double pdf;
+    return bsdf.evaluateBSDF(dir, pdf);
+}
+
+// solid angle pdf at from to per unit area at to
+template <class Vertex>
+static double toArea(const double pdf, const Vertex& from, const Vertex& to) {
+    const Vec3 d = to.isect.pos - from.isect.pos;
+    const double dist2 = Vec3::dot(d, d);
+    if (dist2 == 0.0) return 0.0;
+    const double cosTerm = to.type == Vertex::CAMERA ? 1.0 : Vec3::absDot(d, to.isect.normal) / sqrt(dist2);
+    return pdf * cosTerm / dist2;
+}
+
+void Renderer_BDPT::render(const Scene* scene, const Camera* camera, Film* film) {
+    model = &scene->getModel();
+
+    const auto start = std::chrono::system_clock::now();
+    std::cout << ">> Render : START" << std::endl;
+    reportUnsupported(false, false, false, false);
+    // the light image covers the whole film, so no pixel can be left behind
+    renderPasses(film, 1, false, true, [&](const int i, const int j, const int numSamples, Random& rng) {
+        renderPixel(scene, camera, film, i, j, numSamples, rng);
+    }, [&]() {
+        // one light path per camera sample, spread over the whole film even in a crop window
+        const double spp = film->getAverageSampleCount() * film->getNumCropPixels() / film->getNumPixels();
+        film->setSplatScale(0.0 < spp ? 1.0 / spp : 0.0);
+    });
+
+    const auto end = std::chrono::system_clock::now();
+    const auto duration = end - start;
+    const auto msec = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+    std::cout << std::endl << ">> Render : FINISH" << std::endl
+        << ">> Render : Time " << msec << "msec" << std::endl << std::endl;
+    film->setRenderStatus(msec, (int)(film->getAverageSampleCount() + 0.5));
+}
+
+void Renderer_BDPT::renderPixel(const Scene* scene, const Camera* camera, Film* film, const int i, const int j, const int numSamples, Random& rng) const {
+    const int p = i + film->width * j;
+    const int firstSample = film->getSampleCount(p);
+    Sampler sampler(firstSample);
+    // a path has at most maxBounce + 1 vertices between the camera and the light, as in Renderer_PT
+    const int maxVertices = maxBounce + 3;
+    std::vector<Vertex> cameraPath(maxVertices);
+    std::vector<Vertex> lightPath(maxVertices - 1);
+    for (int n = 0; n < numSamples; n++) {
+        rng.start(i, j, film->width, firstSample + n);
+        const int numCameraVertices = traceCameraPath(scene, camera, film, i, j, sampler, cameraPath, rng);
+        const int numLightVertices = traceLightPath(scene, lightPath, rng);
+
+        Vec3 radiance;
+        for (int t = 1; t <= numCameraVertices; t++) {
+            for (int s = 0; s <= numLightVertices; s++) {
+                // s == 1, t == 1 would be a light seen by the camera, which s == 0 finds
+                if (t == 1 && s < 2) continue;
+                if (maxVertices < s + t) break;
+                int splatPixel = -1;
+                const Vec3 L = connect(scene, camera, film, lightPath, cameraPath, s, t, splatPixel, rng);
+                if (L == Vec3::black()) continue;
+                if (t == 1) film->addSplat(L, splatPixel);
+                else radiance = radiance + L;
+            }
+        }
+        film->addSample(radiance, p);
+    }
+    film->updatePixelColor(p);
+}
+
+int Renderer_BDPT::traceCameraPath(const Scene* scene, const Camera* camera, const Film* film, const int i, const int j, Sampler& sampler, std::vector<Vertex>& path, Random& rng) const {
+    const Vec3& eye = camera->getEye();
+    const Vec3 target = camera->samplePixel(i, j, film->width, film->height, rng, sampler);
+    const Ray ray(eye, target - eye);
+    Vertex& vertex = path[0];
+    vertex = Vertex();
+    vertex.type = Vertex::CAMERA;
+    vertex.isect.pos = eye;
+    vertex.beta = Vec3(1.0, 1.0, 1.0);
+    // We * cos / pdf is 1 for the pixel
+    return randomWalk(scene, ray, vertex.beta, camera->getDirectionPdf(ray.d), path, Random::DIM_BOUNCE, rng);
+}
+
+int Renderer_BDPT::traceLightPath(const Scene* scene, std::vector<Vertex>& path, Random& rng) const {
+    if (!model->hasLights() || path.empty()) return 0;
+    // after the dimensions of every bounce of the camera path
+    const uint32_t dimension = Random::DIM_BOUNCE + (maxBounce + 2) * Random::DIMS_PER_BOUNCE;
+    rng.setDimension(dimension + Random::DIM_LIGHT);
+    const LightSample light = model->sampleEmission(rng);
+    if (light.pdf == 0.0) return 0;
+    Vertex& vertex = path[0];
+    vertex = Vertex();
+    vertex.type = Vertex::LIGHT;
+    vertex.isect.pos = light.pos;
+    vertex.isect.normal = light.normal;
+    vertex.isect.mtlPtr = light.mtlPtr;
+    vertex.isect.faceIndex = light.faceIndex;
+    vertex.beta = light.mtlPtr->Ke / light.pdf;
+    vertex.pdfFwd = light.pdf;
+
+    // cosine weighted about the normal
+    rng.setDimension(dimension + Random::DIM_BSDF);
+    const double r = sqrt(rng.next());
+    const double theta = 2.0 * M_PI * rng.next();
+    const double cosTheta = sqrt(fmax(0.0, 1.0 - r * r));
+    if (cosTheta == 0.0) return 1;
+    const Vec3 dirLocal(r * cos(theta), cosTheta, r * sin(theta));
+    const Ray ray(light.pos, Vec3::convertVectorRelativeToN(dirLocal, light.normal));
+    const double pdfDir = cosTheta / M_PI;
+    return randomWalk(scene, ray, vertex.beta * (cosTheta / pdfDir), pdfDir, path, dimension + Random::DIMS_PER_BOUNCE, rng);
+}
+
+int Renderer_BDPT::randomWalk(const Scene* scene, Ray ray, Vec3 beta, double pdfDir, std::vector<Vertex>& path, uint32_t dimension, Random& rng) const {
+    // the roulette sees the throughput relative to the start, a light path starts at its power
+    const double rouletteScale = 1.0 / maxComponent(beta);
+    int numVertices = 1;
+    while (numVertices < (int)path.size()) {
+        const Intersect isect = scene->intersect(ray, rng);
+        if (isect.t == H_INFINITE) break;
+        Vertex& prev = path[numVertices - 1];
+        Vertex& vertex = path[numVertices++];
+        vertex = Vertex();
+        vertex.isect = isect;
+        vertex.ray = ray;
+        vertex.beta = beta;
+        vertex.pdfFwd = toArea(pdfDir, prev, vertex);
+        // the other materials are lit as diffuse but not sampled
+        const int illum = isect.mtlPtr->illum;
+        if ((illum != 2 && illum != 5 && illum != 7) || numVertices == (int)path.size()) break;
+
+        BSDF bsdf = BSDF(ray, isect, Vec3::absDot(ray.d, isect.normal));
+        rng.setDimension(dimension + Random::DIM_BSDF);
+        const Vec3 dir = bsdf.evaluateDirection(rng);
+        double pdfRev = 0.0;
+        if (bsdf.isDelta()) {
+            // the same in both directions, the vertex drops out of the MIS weights
+            vertex.isDelta = true;
+            double pdf;
+            const Vec3 fs = bsdf.evaluateBSDF(pdf);
+            beta = beta * fs * (bsdf.getCosTerm() / pdf);
+            pdfDir = 0.0;
+        }
+        else {
+            const Vec3 fs = bsdf.evaluateBSDF(dir, pdfDir);
+            if (pdfDir == 0.0) break;
+            beta = beta * fs * (Vec3::absDot(dir, isect.normal) / pdfDir);
+            // the BSDF sampled from the other side, toward where the ray came from
+            const BSDF reverse(Ray(isect.pos, -dir), isect, 0.0);
+            reverse.evaluateBSDF(-ray.d, pdfRev);
+        }
+        prev.pdfRev = toArea(pdfRev, vertex, prev);
+
+        // Russian Roulette
+        const double prob = fmin(1.0, maxComponent(beta) * rouletteScale);
+        rng.setDimension(dimension + Random::DIM_ROULETTE);
+        if (prob == 0.0 || prob < rng.next()) break;
+        beta = beta / prob;
+        ray = Ray(isect.pos, dir);
+        dimension += Random::DIMS_PER_BOUNCE;
+    }
+    return numVertices;
+}
+
+Vec3 Renderer_BDPT::connect(const Scene* scene, const Camera* camera, const Film* film, const std::vector<Vertex>& lightPath, const std::vector<Vertex>& cameraPath, const int s, const int t, int& splatPixel, Random& rng) const {
+    const Vec3 black = Vec3::black();
+    Vec3 L;
+    Vertex sampled; // light point of s == 1
+    if (s == 0) {
+        // the camera path hit a light from its front
+        const Vertex& pt = cameraPath[t - 1];
+        if (pt.type != Vertex::SURFACE || pt.isect.mtlPtr->Ke == black) return black;
+        if (Vec3::dot(pt.isect.normal, pt.ray.d) >= 0.0) return black;
+        L = pt.beta * pt.isect.mtlPtr->Ke;
+    }
+    else if (t == 1) {
+        // the light path seen by the camera
+        const Vertex& qs = lightPath[s - 1];
+        if (!isConnectible(qs)) return black;
+        const Vec3& eye = camera->getEye();
+        const Vec3 toEye = eye - qs.isect.pos;
+        const Ray shadowRay(qs.isect.pos, toEye);
+        int i, j;
+        if (!camera->getPixel(-shadowRay.d, film->width, film->height, i, j)) return black;
+        const Vec3 fs = evaluateBSDF(qs, shadowRay.d);
+        if (fs == black) return black;
+        const double dist2 = Vec3::dot(toEye, toEye);
+        if (!isVisible(scene->intersect(shadowRay, rng), dist2)) return black;
+        const double cosCamera = Vec3::dot(-shadowRay.d, (camera->getCenter() - eye).normalize());
+        const double G = cosCamera * Vec3::absDot(shadowRay.d, qs.isect.normal) / dist2;
+        L = qs.beta * fs * (camera->getImportance(-shadowRay.d) * G);
+        splatPixel = i + film->width * j;
+    }
+    else if (s == 1) {
+        // a light sampled for the camera vertex, as Renderer_NEE does
+        const Vertex& pt = cameraPath[t - 1];
+        if (!isConnectible(pt)) return black;
+        rng.setDimension(t - 2, Random::DIM_LIGHT);
+        const LightSample light = model->sampleLight(pt.isect.pos, pt.isect.normal, rng);
+        if (light.pdf == 0.0) return black;
+        const Ray shadowRay(pt.isect.pos, light.pos - pt.isect.pos);
+        const double cosLight = Vec3::dot(light.normal, -shadowRay.d);
+        if (cosLight <= 0.0) return black;
+        const Vec3 fs = evaluateBSDF(pt, shadowRay.d);
+        if (fs == black) return black;
+        const double dist2 = Vec3::dist2(light.pos, pt.isect.pos);
+        if (!isVisible(scene->intersect(shadowRay, rng), dist2)) return black;
+        const double G = Vec3::absDot(shadowRay.d, pt.isect.normal) * cosLight / dist2;
+        L = pt.beta * fs * light.mtlPtr->Ke * (G / light.pdf);
+        sampled.type = Vertex::LIGHT;
+        sampled.isect.pos = light.pos;
+        sampled.isect.normal = light.normal;
+        sampled.isect.mtlPtr = light.mtlPtr;
+        // as if the light path had started there
+        sampled.pdfFwd = model->getEmissionPdf(*light.mtlPtr);
+    }
+    else {
+        const Vertex& qs = lightPath[s - 1];
+        const Vertex& pt = cameraPath[t - 1];
+        if (!isConnectible(qs) || !isConnectible(pt)) return black;
+        const Ray shadowRay(pt.isect.pos, qs.isect.pos - pt.isect.pos);
+        const Vec3 fsCamera = evaluateBSDF(pt, shadowRay.d);
+        if (fsCamera == black) return black;
+        const Vec3 fsLight = evaluateBSDF(qs, -shadowRay.d);
+        if (fsLight == black) return black;
+        const double dist2 = Vec3::dist2(qs.isect.pos, pt.isect.pos);
+        if (!isVisible(scene->intersect(shadowRay, rng), dist2)) return black;
+        const double G = Vec3::absDot(shadowRay.d, pt.isect.normal) * Vec3::absDot(shadowRay.d, qs.isect.normal) / dist2;
+        L = qs.beta * fsLight * fsCamera * pt.beta * G;
+    }
+    if (L == black) return black;
+    return L * getMISWeight(camera, lightPath, cameraPath, sampled, s, t);
+}
+
+// power heuristic over every (s, t) that makes the same path, from the ratios of their pdfs
+// to the pdf of this one, walking from the connection toward either end
+double Renderer_BDPT::getMISWeight(const Camera* camera, const std::vector<Vertex>& lightPath, const std::vector<Vertex>& cameraPath, const Vertex& sampled, const int s, const int t) const {
+    if (s + t == 2) return 1.0;
+    const Vertex* qs = s == 1 ? &sampled : (1 < s ? &lightPath[s - 1] : NULL);
+    const Vertex* qsMinus = 1 < s ? &lightPath[s - 2] : NULL;
+    const Vertex& pt = cameraPath[t - 1];
+    const Vertex* ptMinus = 1 < t ? &cameraPath[t - 2] : NULL;
+
+    // the vertices at the connection and the ones before them, sampled from across it
+    double ptRev = 0.0, ptMinusRev = 0.0, qsRev = 0.0, qsMinusRev = 0.0;
+    if (qs) {
+        ptRev = toArea(getPdf(camera, *qs, qsMinus, pt), *qs, pt);
+        if (ptMinus) ptMinusRev = toArea(getPdf(camera, pt, qs, *ptMinus), pt, *ptMinus);
+        qsRev = toArea(getPdf(camera, pt, ptMinus, *qs), pt, *qs);
+        if (qsMinus) qsMinusRev = toArea(getPdf(camera, *qs, &pt, *qsMinus), *qs, *qsMinus);
+    }
+    else {
+        // pt as the start of a light path
+        Vertex light = pt;
+        light.type = Vertex::LIGHT;
+        ptRev = model->getEmissionPdf(*pt.isect.mtlPtr);
+        ptMinusRev = toArea(getPdf(camera, light, NULL, *ptMinus), pt, *ptMinus);
+    }
+
+    double sumRi = 0.0;
+    double ri = 1.0;
+    for (int i = t - 1; 0 < i; i--) {
+        const Vertex& v = cameraPath[i];
+        const double pdfRev = i == t - 1 ? ptRev : (i == t - 2 ? ptMinusRev : v.pdfRev);
+        ri *= remap0(pdfRev) / remap0(v.pdfFwd);
+        const bool isDelta = i != t - 1 && v.isDelta;
+        if (!isDelta && !cameraPath[i - 1].isDelta) sumRi += ri * ri;
+    }
+    ri = 1.0;
+    for (int i = s - 1; 0 <= i; i--) {
+        const Vertex& v = s == 1 ? sampled : lightPath[i];
+        const double pdfRev = i == s - 1 ? qsRev : (i == s - 2 ? qsMinusRev : v.pdfRev);
+        ri *= remap0(pdfRev) / remap0(v.pdfFwd);
+        const bool isDelta = i != s - 1 && v.isDelta;
+        const bool isPrevDelta = 0 < i && lightPath[i - 1].isDelta;
+        if (!isDelta && !isPrevDelta) sumRi += ri * ri;
+    }
+    return 1.0 / (1.0 + sumRi);
+}
+
+double Renderer_BDPT::getPdf(const Camera* camera, const Vertex& v, const Vertex* prev, const Vertex& next) const {
+    const Vec3 dir = (next.isect.pos - v.isect.pos).normalize();
+    if (v.type == Vertex::CAMERA) return camera->getDirectionPdf(dir);
+    if (v.type == Vertex::LIGHT) return fmax(0.0, Vec3::dot(v.isect.normal, dir)) / M_PI;
+    const BSDF bsdf(Ray(prev->isect.pos, v.isect.pos - prev->isect.pos), v.isect, 0.0);
+    double pdf;
+    bsdf.evaluateBSDF(dir, pdf);
+    return pdf;
+}
\ No newline at end of file
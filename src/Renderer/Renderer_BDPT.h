@@ -0,0 +1,47 @@
+#pragma once
+
+namespace hiraishi {
+    // Bidirectional path tracer. Every camera sample also traces a path from a light, and every
+    // vertex of one is connected to every vertex of the other. A path that several of these
+    // connections can make is weighted by the power heuristic over all of them. [Veach, 1997]
+    // Connections of the light path to the camera land in any pixel, they are splatted to the
+    // light image of the film.
+    class Renderer_BDPT : public Renderer {
+    private:
+        struct Vertex {
+            enum Type { CAMERA, LIGHT, SURFACE };
+            Type type = SURFACE;
+            Intersect isect; // pos and normal of every type, the material of lights and surfaces
+            Ray ray;         // that reached a surface, for its BSDF
+            Vec3 beta;       // throughput of the subpath up to the vertex
+            // per unit area of sampling the vertex from the one before it in its subpath,
+            // and from the one after it as if the subpath had been traced the other way
+            double pdfFwd = 0.0;
+            double pdfRev = 0.0;
+            bool isDelta = false;
+        };
+
+        const ModelSet* model = NULL;
+
+        void renderPixel(const Scene* scene, const Camera* camera, Film* film, const int i, const int j, const int numSamples, Random& rng) const;
+        int traceCameraPath(const Scene* scene, const Camera* camera, const Film* film, const int i, const int j, Sampler& sampler, std::vector<Vertex>& path, Random& rng) const;
+        int traceLightPath(const Scene* scene, std::vector<Vertex>& path, Random& rng) const;
+        // extends the subpath from its first vertex, returns its number of vertices
+        int randomWalk(const Scene* scene, Ray ray, Vec3 beta, double pdfDir, std::vector<Vertex>& path, uint32_t dimension, Random& rng) const;
+        // radiance of the path made of the first s vertices of the light path and the first t of
+        // the camera path, weighted, t == 1 sets the pixel it is splatted to
+        Vec3 connect(const Scene* scene, const Camera* camera, const Film* film, const std::vector<Vertex>& lightPath, const std::vector<Vertex>& cameraPath, const int s, const int t, int& splatPixel, Random& rng) const;
+        double getMISWeight(const Camera* camera, const std::vector<Vertex>& lightPath, const std::vector<Vertex>& cameraPath, const Vertex& sampled, const int s, const int t) const;
+        // solid angle pdf of leaving v toward next, when v was reached from prev (not used by the camera and lights)
+        double getPdf(const Camera* camera, const Vertex& v, const Vertex* prev, const Vertex& next) const;
+
+    public:
+        Renderer_BDPT() {}
+        Renderer_BDPT(const ModelSet& model_) {
+            model = &model_;
+        }
+        ~Renderer_BDPT() {}
+
+        void render(const Scene* scene, const Camera* camera, Film* film);
+    };
+}
\ No newline at end of file
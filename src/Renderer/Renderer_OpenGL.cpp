@@ -26,12 +26,11 @@ void Renderer_OpenGL::render(const Scene* scene, const Camera* camera, Film* fil
     gluLookAt(eye.x, eye.y, eye.z, center.x, center.y, center.z, 0.0, 1.0, 0.0);
     glBegin(GL_TRIANGLES);
 
-    for (unsigned int i = 0; i < model.getFaces().size(); ++i) {
-        const Face face = model.getFaces()[i];
-        const Vec3 color = face.getMtlPtr()->Kd;
+    for (unsigned int i = 0; i < model.getNumFaces(); ++i) {
+        const Vec3 color = model.getMaterials()[model.getFaceMtlIndex(i)].Kd;
         for (int j = 0; j < 3; ++j) {
-            const Vec3 v = model.getVertices()[face.getVIndex(j) - 1];
-            const Vec3 vColor = model.getVColors()[face.getVIndex(j) - 1];
+            const Vec3 v = model.getFaceVertex(i, j);
+            const Vec3 vColor = model.getVColors()[model.getFaceVIndex(i, j)];
             glColor3d(vColor.x, vColor.y, vColor.z);
             glVertex3f(v.x, v.y, v.z);
         }
@@ -0,0 +1,267 @@
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <omp.h>
+#include "../Constant.h"
+#include "../Random.h"
+#include "../Vec3.h"
+#include "../Spectrum.h"
+#include "../Sampler.h"
+#include "../Camera.h"
+#include "../Materials/Material.h"
+#include "../Ray.h"
+#include "../BBox.h"
+#include "../Face.h"
+#include "../Sphere.h"
+#include "../Intersect.h"
+#include "../Materials/BSDF.h"
+#include "../Accelerator/KdTree.h"
+#include "../ModelSet.h"
+#include "../Film.h"
+#include "../Scene.h"
+#include "Renderer.h"
+#include "DirectLight.h"
+#include "TileScheduler.h"
+#include "Renderer_Wavefront.h"
+
+using namespace hiraishi;
+
+// illum of .mtl is 0 to 10
+static const int NUM_ILLUM = 11;
+
+static int illumQueue(const int illum) {
+    return illum < 0 ? 0 : (NUM_ILLUM <= illum ? NUM_ILLUM - 1 : illum);
+}
+
+void Renderer_Wavefront::PathBuffer::resize(const size_t numPaths) {
+    rngs.resize(numPaths);
+    rayOrigins.resize(numPaths);
+    rayDirs.resize(numPaths);
+    hitMtls.resize(numPaths);
+    hitPositions.resize(numPaths);
+    hitNormals.resize(numPaths);
+    throughputs.resize(numPaths);
+    radiances.resize(numPaths);
+    pixels.resize(numPaths);
+    bounces.resize(numPaths);
+    isLightSampled.resize(numPaths);
+    bsdfPdfs.resize(numPaths);
+    active.reserve(numPaths);
+    hits.reserve(numPaths);
+    sorted.resize(numPaths);
+    shadowRays.reserve(numPaths);
+}
+
+void Renderer_Wavefront::render(const Scene* scene, const Camera* camera, Film* film) {
+    model = &scene->getModel();
+    buffers.resize(omp_get_max_threads());
+
+    const auto start = std::chrono::system_clock::now();
+    std::cout << ">> Render : START" << std::endl;
+    reportUnsupported(false, false, false, false);
+    renderPasses(film, 1, true, true, [&](const RenderTile& tile, const int numSamples, const std::vector<char>* mask, Random&) {
+        addTile(scene, camera, film, tile, numSamples, mask, buffers[omp_get_thread_num()]);
+    }, PassFunc(), [&]() {
+        flushTiles(scene, camera, film, buffers[omp_get_thread_num()]);
+    });
+
+    const auto end = std::chrono::system_clock::now();
+    const auto duration = end - start;
+    const auto msec = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+    std::cout << std::endl << ">> Render : FINISH" << std::endl
+        << ">> Render : Time " << msec << "msec" << std::endl << std::endl;
+    film->setRenderStatus(msec, (int)(film->getAverageSampleCount() + 0.5));
+    buffers.clear();
+}
+
+void Renderer_Wavefront::addTile(const Scene* scene, const Camera* camera, Film* film, const RenderTile& tile, const int numSamples, const std::vector<char>* mask, PathBuffer& buffer) {
+    if (buffer.pendingSamples != numSamples) flushTiles(scene, camera, film, buffer);
+    buffer.pendingSamples = numSamples;
+    for (int j = tile.y0; j < tile.y1; j++) {
+        for (int i = tile.x0; i < tile.x1; i++) {
+            const int p = i + film->width * j;
+            if (mask && !(*mask)[p]) continue;
+            buffer.pendingPixels.push_back(p);
+        }
+    }
+    if (maxPathsPerBatch <= (int)buffer.pendingPixels.size() * numSamples) flushTiles(scene, camera, film, buffer);
+}
+
+void Renderer_Wavefront::flushTiles(const Scene* scene, const Camera* camera, Film* film, PathBuffer& buffer) {
+    if (!buffer.pendingPixels.empty()) renderPixels(scene, camera, film, buffer.pendingPixels, buffer.pendingSamples, buffer);
+    buffer.pendingPixels.clear();
+}
+
+void Renderer_Wavefront::renderPixels(const Scene* scene, const Camera* camera, Film* film, const std::vector<int>& pixels, const int numSamples, PathBuffer& buffer) {
+    // large passes are split so that the buffer stays bounded
+    const int samplesPerBatch = std::max(1, std::min(numSamples, maxPathsPerBatch / (int)pixels.size()));
+    buffer.resize(pixels.size() * samplesPerBatch);
+
+    for (int done = 0; done < numSamples; done += samplesPerBatch) {
+        const int batchSamples = std::min(samplesPerBatch, numSamples - done);
+        generateCameraRays(camera, film, pixels, batchSamples, buffer);
+        const int numPaths = (int)buffer.active.size();
+
+        while (!buffer.active.empty()) {
+            intersectRays(scene, buffer);
+            sortByMaterial(buffer);
+            shade(buffer);
+            traceShadowRays(scene, buffer);
+        }
+
+        // paths are ordered by pixel then sample, as the per pixel renderers add them
+        for (int k = 0; k < numPaths; k++) {
+            film->addSample(buffer.radiances[k], buffer.pixels[k]);
+        }
+    }
+
+    for (size_t k = 0; k < pixels.size(); k++) {
+        film->updatePixelColor(pixels[k]);
+    }
+}
+
+void Renderer_Wavefront::generateCameraRays(const Camera* camera, Film* film, const std::vector<int>& pixels, const int numSamples, PathBuffer& buffer) const {
+    const Vec3& eye = camera->getEye();
+    const float* blueNoise = isBlueNoise ? BlueNoise::getTile() : nullptr;
+    buffer.active.clear();
+    int k = 0;
+    for (size_t n = 0; n < pixels.size(); n++) {
+        const int p = pixels[n];
+        const int i = p % film->width;
+        const int j = p / film->width;
+        const int firstSample = film->getSampleCount(p);
+        Sampler sampler(firstSample);
+        for (int s = 0; s < numSamples; s++) {
+            Random& rng = buffer.rngs[k];
+            rng.isSobol = isSobol;
+            rng.blueNoise = blueNoise;
+            rng.start(i, j, film->width, firstSample + s);
+            const Vec3 target = camera->samplePixel(i, j, film->width, film->height, rng, sampler);
+            buffer.rayOrigins[k] = eye;
+            buffer.rayDirs[k] = (target - eye).normalize();
+            buffer.throughputs[k] = Vec3(1.0, 1.0, 1.0);
+            buffer.radiances[k] = Vec3(0.0, 0.0, 0.0);
+            buffer.pixels[k] = p;
+            buffer.bounces[k] = 0;
+            buffer.isLightSampled[k] = 0;
+            buffer.active.push_back(k);
+            k++;
+        }
+    }
+}
+
+void Renderer_Wavefront::intersectRays(const Scene* scene, PathBuffer& buffer) const {
+    buffer.hits.clear();
+    for (size_t n = 0; n < buffer.active.size(); n++) {
+        const int k = buffer.active[n];
+        Ray ray;
+        ray.o = buffer.rayOrigins[k];
+        ray.d = buffer.rayDirs[k];
+        const Intersect isect = scene->intersect(ray, buffer.rngs[k]);
+        if (isect.t == H_INFINITE) continue;
+
+        // Add Le, weighted against the light sample of the previous vertex as Renderer_Integrator does,
+        // the hit of the previous vertex is still in the buffer
+        if (isect.mtlPtr->Ke != Vec3::black()) {
+            double weight = 1.0;
+            if (buffer.isLightSampled[k]) {
+                const double cosLight = Vec3::dot(isect.normal, -ray.d);
+                const double lightPdf = (0.0 < cosLight) ? model->getLightPdf(ray.o, buffer.hitNormals[k], isect) * isect.t * isect.t / cosLight : 0.0;
+                weight = powerHeuristic(buffer.bsdfPdfs[k], lightPdf);
+            }
+            buffer.radiances[k] = buffer.radiances[k] + isect.mtlPtr->Ke * buffer.throughputs[k] * weight;
+        }
+        buffer.hitMtls[k] = isect.mtlPtr;
+        buffer.hitPositions[k] = isect.pos;
+        buffer.hitNormals[k] = isect.normal;
+        buffer.hits.push_back(k);
+    }
+}
+
+void Renderer_Wavefront::sortByMaterial(PathBuffer& buffer) const {
+    // counting sort, stable so that paths of a queue stay in pixel order
+    int offsets[NUM_ILLUM + 1] = {};
+    for (size_t n = 0; n < buffer.hits.size(); n++) {
+        offsets[illumQueue(buffer.hitMtls[buffer.hits[n]]->illum) + 1]++;
+    }
+    for (int q = 0; q < NUM_ILLUM; q++) {
+        offsets[q + 1] += offsets[q];
+    }
+    for (size_t n = 0; n < buffer.hits.size(); n++) {
+        const int k = buffer.hits[n];
+        buffer.sorted[offsets[illumQueue(buffer.hitMtls[k]->illum)]++] = k;
+    }
+}
+
+void Renderer_Wavefront::shade(PathBuffer& buffer) const {
+    buffer.active.clear();
+    buffer.shadowRays.clear();
+    for (size_t n = 0; n < buffer.hits.size(); n++) {
+        const int k = buffer.sorted[n];
+        Intersect isect;
+        isect.mtlPtr = buffer.hitMtls[k];
+        isect.pos = buffer.hitPositions[k];
+        isect.normal = buffer.hitNormals[k];
+        Ray ray;
+        ray.o = buffer.rayOrigins[k];
+        ray.d = buffer.rayDirs[k];
+        Vec3& throughput = buffer.throughputs[k];
+        Random& rng = buffer.rngs[k];
+
+        const double cosTerm = Vec3::absDot(ray.d, isect.normal);
+        BSDF bsdf = BSDF(ray, isect, cosTerm);
+        const bool isLightSampled = isNEE && model->hasLights() && !bsdf.isDelta();
+
+        // queue a shadow ray, traced once every material queue is shaded
+        if (isLightSampled) {
+            ShadowRay shadowRay;
+            shadowRay.path = k;
+            rng.setDimension(buffer.bounces[k], Random::DIM_LIGHT);
+            shadowRay.light = model->sampleLight(isect.pos, isect.normal, rng);
+            shadowRay.ray = Ray(isect.pos, shadowRay.light.pos - isect.pos);
+            shadowRay.weight = throughput * bsdf.evaluateBSDF(shadowRay.ray.d, shadowRay.bsdfPdf);
+            buffer.shadowRays.push_back(shadowRay);
+        }
+
+        // Set next ray and update throughput
+        rng.setDimension(buffer.bounces[k], Random::DIM_BSDF);
+        const Vec3 dir = bsdf.evaluateDirection(rng);
+        double pdf = 1.0;
+        const Vec3 fs = bsdf.evaluateBSDF(pdf);
+        buffer.rayOrigins[k] = isect.pos;
+        buffer.rayDirs[k] = dir.normalize();
+        throughput = throughput * fs * bsdf.getCosTerm() / pdf;
+        buffer.isLightSampled[k] = isLightSampled;
+        if (isLightSampled) bsdf.evaluateBSDF(dir, buffer.bsdfPdfs[k]);
+
+        // Russian Roulette, a glossy sample can raise the throughput above 1
+        const double prob = fmin(1.0, fmax(throughput.x, fmax(throughput.y, throughput.z)));
+        if (prob == 0) continue;
+        rng.setDimension(buffer.bounces[k], Random::DIM_ROULETTE);
+        if (prob < rng.next() || maxBounce < buffer.bounces[k]) continue;
+        throughput = throughput / prob;
+
+        buffer.bounces[k]++;
+        buffer.active.push_back(k);
+    }
+}
+
+void Renderer_Wavefront::traceShadowRays(const Scene* scene, PathBuffer& buffer) const {
+    for (size_t n = 0; n < buffer.shadowRays.size(); n++) {
+        const ShadowRay& shadowRay = buffer.shadowRays[n];
+        const Vec3& pos = buffer.hitPositions[shadowRay.path];
+        const double dot1 = Vec3::dot(buffer.hitNormals[shadowRay.path], shadowRay.ray.d);
+        const double dot2 = Vec3::dot(shadowRay.light.normal, -shadowRay.ray.d);
+        if (dot1 <= 0.0 || dot2 <= 0.0) continue;
+
+        // occluded if anything is hit before the sampled point
+        const double dist2 = Vec3::dist2(shadowRay.light.pos, pos);
+        if (!isVisible(scene->intersect(shadowRay.ray, buffer.rngs[shadowRay.path]), dist2)) continue;
+
+        // both pdfs per solid angle at the shading point
+        const double G = dot1 * dot2 / dist2;
+        const double weight = powerHeuristic(shadowRay.light.pdf * dist2 / dot2, shadowRay.bsdfPdf);
+        buffer.radiances[shadowRay.path] = buffer.radiances[shadowRay.path] + shadowRay.weight * shadowRay.light.mtlPtr->Ke * (weight * G / shadowRay.light.pdf);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+namespace hiraishi {
+    // Path tracer that advances all paths of a batch of tiles one bounce at a time.
+    // Each bounce runs as separate stages over arrays of path state: intersect every ray,
+    // sort the hits by material (illum), shade one material queue after another,
+    // then trace the shadow rays the shading stage queued.
+    class Renderer_Wavefront : public Renderer {
+    private:
+        struct ShadowRay {
+            int path;
+            Ray ray;
+            LightSample light;
+            Vec3 weight; // throughput * BSDF at the shading point
+            double bsdfPdf; // of the BSDF toward the light, per solid angle
+        };
+
+        // state of one batch of paths, struct of arrays so that a stage only reads the fields it uses
+        struct PathBuffer {
+            std::vector<Random> rngs; // stream of each path
+            std::vector<Vec3> rayOrigins;
+            std::vector<Vec3> rayDirs; // normalized
+            // surface the ray hit in this bounce
+            std::vector<const Material*> hitMtls;
+            std::vector<Vec3> hitPositions;
+            std::vector<Vec3> hitNormals;
+            std::vector<Vec3> throughputs;
+            std::vector<Vec3> radiances;
+            std::vector<int> pixels;
+            std::vector<int> bounces;
+            std::vector<char> isLightSampled; // at the previous vertex, its emission is weighted against that sample
+            std::vector<double> bsdfPdfs;     // of the ray from the previous vertex, per solid angle
+            std::vector<int> active;     // paths still traced
+            std::vector<int> hits;       // paths whose ray hit a surface in this bounce
+            std::vector<int> sorted;     // hits ordered by illum
+            std::vector<ShadowRay> shadowRays;
+            // pixels of the tiles taken in this pass, traced once they make a batch
+            std::vector<int> pendingPixels;
+            int pendingSamples = 0;
+
+            void resize(const size_t numPaths);
+        };
+
+        const ModelSet* model = NULL;
+        std::vector<PathBuffer> buffers; // one per thread
+
+        void addTile(const Scene* scene, const Camera* camera, Film* film, const RenderTile& tile, const int numSamples, const std::vector<char>* mask, PathBuffer& buffer);
+        void flushTiles(const Scene* scene, const Camera* camera, Film* film, PathBuffer& buffer);
+        void renderPixels(const Scene* scene, const Camera* camera, Film* film, const std::vector<int>& pixels, const int numSamples, PathBuffer& buffer);
+        void generateCameraRays(const Camera* camera, Film* film, const std::vector<int>& pixels, const int numSamples, PathBuffer& buffer) const;
+        void intersectRays(const Scene* scene, PathBuffer& buffer) const;
+        void sortByMaterial(PathBuffer& buffer) const;
+        void shade(PathBuffer& buffer) const;
+        void traceShadowRays(const Scene* scene, PathBuffer& buffer) const;
+
+    public:
+        Renderer_Wavefront() {}
+        Renderer_Wavefront(const ModelSet& model_) {
+            model = &model_;
+        }
+        ~Renderer_Wavefront() {}
+
+        // tiles are gathered into batches of up to this many paths, a smaller batch leaves
+        // more tiles to be stolen by idle threads, a tile above it is split by samples
+        int maxPathsPerBatch = 1 << 14;
+        bool isNEE = true; // queue shadow rays to sampled emissive faces as Renderer_NEE does
+
+        void render(const Scene* scene, const Camera* camera, Film* film);
+    };
+}
\ No newline at end of file
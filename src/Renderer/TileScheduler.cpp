@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include "TileScheduler.h"
+
+using namespace hiraishi;
+
+static uint64_t packRange(const uint32_t head, const uint32_t tail) {
+    return ((uint64_t)head << 32) | tail;
+}
+
+TileScheduler::TileScheduler(const RenderTile& region, const int tileSize, const int numThreads)
+    : queues(numThreads < 1 ? 1 : numThreads), numPixels((region.x1 - region.x0) * (region.y1 - region.y0)), numFinishedPixels(0), reportedPercent(0) {
+    const int size = tileSize < 1 ? 1 : tileSize;
+    for (int y = region.y0; y < region.y1; y += size) {
+        for (int x = region.x0; x < region.x1; x += size) {
+            Tile tile;
+            tile.x0 = x;
+            tile.y0 = y;
+            tile.x1 = x + size < region.x1 ? x + size : region.x1;
+            tile.y1 = y + size < region.y1 ? y + size : region.y1;
+            tiles.push_back(tile);
+        }
+    }
+
+    // neighbouring tiles go to the same thread
+    const size_t numQueues = queues.size();
+    for (size_t q = 0; q < numQueues; q++) {
+        const uint32_t head = (uint32_t)(tiles.size() * q / numQueues);
+        const uint32_t tail = (uint32_t)(tiles.size() * (q + 1) / numQueues);
+        queues[q].range.store(packRange(head, tail));
+    }
+}
+
+void TileScheduler::setProgressRange(const int begin, const int end) {
+    progressBegin = begin;
+    progressEnd = end;
+    reportedPercent = begin;
+}
+
+bool TileScheduler::popFront(const int queueIndex, int& tileIndex) {
+    std::atomic<uint64_t>& range = queues[queueIndex].range;
+    uint64_t current = range.load();
+    while (true) {
+        const uint32_t head = (uint32_t)(current >> 32);
+        const uint32_t tail = (uint32_t)current;
+        if (tail <= head) return false;
+        if (range.compare_exchange_weak(current, packRange(head + 1, tail))) {
+            tileIndex = head;
+            return true;
+        }
+    }
+}
+
+bool TileScheduler::popBack(const int queueIndex, int& tileIndex) {
+    std::atomic<uint64_t>& range = queues[queueIndex].range;
+    uint64_t current = range.load();
+    while (true) {
+        const uint32_t head = (uint32_t)(current >> 32);
+        const uint32_t tail = (uint32_t)current;
+        if (tail <= head) return false;
+        if (range.compare_exchange_weak(current, packRange(head, tail - 1))) {
+            tileIndex = tail - 1;
+            return true;
+        }
+    }
+}
+
+bool TileScheduler::next(const int threadId, Tile& tile) {
+    const int numQueues = (int)queues.size();
+    const int own = threadId % numQueues;
+    int tileIndex;
+    if (!popFront(own, tileIndex)) {
+        // steal from the far end so the victim keeps its locality
+        bool isStolen = false;
+        for (int k = 1; k < numQueues && !isStolen; k++) {
+            isStolen = popBack((own + k) % numQueues, tileIndex);
+        }
+        if (!isStolen) return false;
+    }
+    tile = tiles[tileIndex];
+    return true;
+}
+
+void TileScheduler::finish(const Tile& tile) {
+    const int numDone = numFinishedPixels.fetch_add((tile.x1 - tile.x0) * (tile.y1 - tile.y0)) + (tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+    const int percent = progressBegin + (int)((long long)numDone * (progressEnd - progressBegin) / numPixels);
+    // only the thread that advances the percentage prints it
+    int reported = reportedPercent.load();
+    while (reported < percent) {
+        if (reportedPercent.compare_exchange_weak(reported, percent)) {
+            fprintf(stderr, ">> Render : %d %%\r", percent);
+            break;
+        }
+    }
+}
\ No newline at end of file
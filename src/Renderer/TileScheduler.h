@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+
+namespace hiraishi {
+    struct RenderTile {
+        int x0, y0; // inclusive
+        int x1, y1; // exclusive
+    };
+
+    // Hands out square tiles of the film, or of a region of it, to render threads.
+    // Each thread owns a contiguous range of tiles and takes them from the front,
+    // a thread that runs out steals from the back of another range.
+    class TileScheduler {
+    public:
+        typedef RenderTile Tile;
+
+    private:
+        // [head, tail) of tile indices packed in one word so both ends are taken with a single CAS,
+        // one cache line per queue
+        struct alignas(64) Queue {
+            std::atomic<uint64_t> range;
+        };
+
+        std::vector<Tile> tiles;
+        std::vector<Queue> queues;
+        int numPixels;
+        std::atomic<int> numFinishedPixels;
+        std::atomic<int> reportedPercent;
+        int progressBegin = 0;
+        int progressEnd = 100;
+
+        bool popFront(const int queueIndex, int& tileIndex);
+        bool popBack(const int queueIndex, int& tileIndex);
+
+    public:
+        // tiles of region, from its corner (x0, y0)
+        TileScheduler(const RenderTile& region, const int tileSize, const int numThreads);
+
+        int getNumTiles() const { return (int)tiles.size(); }
+        // maps the progress of this scheduler to a part of the whole render, in percent
+        void setProgressRange(const int begin, const int end);
+
+        bool next(const int threadId, Tile& tile);
+        void finish(const Tile& tile);
+    };
+}
\ No newline at end of file
@@ -1,151 +1,104 @@
-#include <iostream>
-#include <string>
-#include <chrono>
-#include <omp.h>
-#include "../Constant.h"
+#include <algorithm>
 #include "../Random.h"
 #include "../Vec3.h"
 #include "../Spectrum.h"
-#include "../Sampler.h"
-#include "../Camera.h"
 #include "../Materials/Material.h"
 #include "../Ray.h"
-#include "../BBox.h"
-#include "../Face.h"
-#include "../Sphere.h"
 #include "../Intersect.h"
 #include "../Materials/BSDF.h"
-#include "../Accelerator/KdTree.h"
-#include "../ModelSet.h"
 #include "../Film.h"
-#include "../Scene.h"
-#include "Renderer.h"
-#include "Renderer_SingleSpectrum_PT.h"
+#include "Transport.h"
 
 using namespace hiraishi;
 
-void Renderer_SingleSpectrum_PT::render(const Scene* scene, const Camera* camera, Film* film) {
-    initSpectrum();
-    model = scene->getModel();
-
-    light.setSpectrum(CIEStandardIlluminantD65);
-    light = Spectrum::map(light, 0.0, 25.0);
-
-    const auto start = std::chrono::system_clock::now();
-    std::cout << ">> Render : START" << std::endl;
-    int numFinished = 0;
-
-#pragma omp parallel for schedule(dynamic, 1)
-    for (int j = 0; j < film->height; j++) {
-        thread_local Random rng(42 + omp_get_thread_num());
-        for (int i = 0; i < film->width; i++) {
-            renderPixel(scene, camera, film, i, j, rng);
-        }
-#pragma omp atomic
-        numFinished += 100;
-#pragma omp critical
-        fprintf(stderr, ">> Render : %d %%\r", numFinished / film->height);
-    }
-
-    const auto end = std::chrono::system_clock::now();
-    const auto duration = end - start;
-    const auto msec = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
-    std::cout << std::endl << ">> Render : FINISH" << std::endl
-        << ">> Render : Time " << msec << "msec" << std::endl << std::endl;
-    film->setRenderStatus(msec, spp);
+void RGBTransport::addEmission(Path& path, const Material* mtl, const double weight) const {
+    path.radiance = path.radiance + mtl->Ke * path.throughput * weight;
 }
 
-void Renderer_SingleSpectrum_PT::renderPixel(const Scene* scene, const Camera* camera, Film* film, const int i, const int j, Random& rng) {
-    const int p = i + film->width * j;
-    const Vec3& eye = camera->getEye();
-    Sampler sampler;
-    Spectrum averageSpectrum(0.0);
-    int numLambdaSamples[60] = { 0 };
+void RGBTransport::addDirect(Path& path, const Material* emitter, const BSDF& bsdf, const Vec3& wi, const double scale) const {
+    double pdf;
+    const Vec3 fs = bsdf.evaluateBSDF(wi, pdf);
+    path.radiance = path.radiance + path.throughput * emitter->Ke * (fs * scale);
+}
 
-    for (int s = 0; s < spp; s++) {
-        // Sample pos on film and generate initial ray
-        const Vec3 target = camera->samplePixel(i, j, film->width, film->height, rng, sampler);
-        Ray ray(eye, target - eye);
+void RGBTransport::applyBSDF(Path& path, const BSDF& bsdf, const Intersect&) const {
+    double pdf = 1.0;
+    const Vec3 fs = bsdf.evaluateBSDF(pdf);
+    path.throughput = path.throughput * fs * bsdf.getCosTerm() / pdf;
+}
 
-        // Initialize variables
-        double spectrum(0.0);
-        double throughput(1.0);
-        int lambdaIdx = (int)(rng.next() * 59.999);
+void RGBTransport::applyBSDF(Path& path, const BSDF& bsdf, const Vec3& wi, const double pdf) const {
+    double bsdfPdf;
+    const Vec3 fs = bsdf.evaluateBSDF(wi, bsdfPdf);
+    path.throughput = path.throughput * fs * bsdf.getCosTerm() / pdf;
+}
 
-        int bounce = 0;
-        Intersect isect = scene->intersect(ray, rng);
-        Intersect prevIsect;
+double RGBTransport::getIncidentRadiance(const Path& path, const Path& atVertex) const {
+    const Vec3 radiance = path.radiance - atVertex.radiance;
+    const Vec3& t = atVertex.throughput;
+    const double r = (0.0 < t.x) ? radiance.x / t.x : 0.0;
+    const double g = (0.0 < t.y) ? radiance.y / t.y : 0.0;
+    const double b = (0.0 < t.z) ? radiance.z / t.z : 0.0;
+    return (r + g + b) / 3.0;
+}
 
-        // Main Rendering Loop
-        while (true) {
-            prevIsect = isect;
+void RGBTransport::endPath(Pixel&, const Path& path, Film* film, const int p) const {
+    film->addSample(path.radiance, p);
+}
 
-            // Intersect with model
-            isect = scene->intersect(ray, rng);
-            if (isect.t == H_INFINITE) {
-                #if 0 // use skylight if true
-                const Vec3 sunPos(100.0, 10.0, -5.0);
-                const Sphere sun(sunPos, 10.0);
-                double sunt = H_INFINITE;
-                const bool isSunIsect = sun.intersect(ray, &sunt);
-                const double sunIntensity = 100.0;
+void RGBTransport::endPixel(Pixel&, const int, Film* film, const int p) const {
+    film->updatePixelColor(p);
+}
 
-                if (isSunIsect) {
-                    const double ke = Spectrum::map(light, 0.0, sunIntensity).c[lambdaIdx];
-                    spectrum = spectrum + ke * throughput;
-                }
-                else {
-                    const double t = ray.d.y * 0.5 + 0.5;
-                    const Vec3 c = Vec3(1.0, 1.0, 1.0) * (1.0 - t) + Vec3(0.5, 0.7, 1.0) * t;
-                    const Vec3 RGBcolor = Vec3(std::min(std::max(c.x, 0.0), 1.0), std::min(std::max(c.y, 0.0), 1.0), std::min(std::max(c.z, 0.0), 1.0));
-                    const double s = Spectrum::map(RGB2Spectrum(RGBcolor, 1), 0.0, 1.0).c[lambdaIdx];
-                    spectrum = spectrum + s * throughput;
-                }
+void SpectralTransport::beginPixel(Pixel& pixel) const {
+    pixel.sum = Spectrum(0.0);
+    for (int l = 0; l < numSpectralSamples; l++) {
+        pixel.numLambdaSamples[l] = 0;
+    }
+}
 
-                #endif
+void SpectralTransport::beginPath(Path& path, Random& rng) const {
+    path.radiance = 0.0;
+    path.throughput = 1.0;
+    rng.setDimension(Random::DIM_WAVELENGTH);
+    path.lambdaIdx = (int)(rng.next() * (numSpectralSamples - 0.001));
+}
 
-                break;
-            }
+void SpectralTransport::addDirect(Path& path, const Material*, const BSDF& bsdf, const Vec3& wi, const double scale) const {
+    double pdf;
+    const Spectrum kd = RGB2Spectrum(bsdf.getMaterial()->Kd, 0);
+    const double fs = bsdf.evaluateSpectrumBSDF(wi, pdf, kd).c[path.lambdaIdx];
+    path.radiance = path.radiance + path.throughput * light.c[path.lambdaIdx] * (fs * scale);
+}
 
-            // Add Le
-            if (isect.mtlPtr->Ke != Vec3::black()) {
-                const double ke = light.c[lambdaIdx];
-                spectrum = spectrum + ke * throughput;
-            }
+void SpectralTransport::applyBSDF(Path& path, const BSDF& bsdf, const Intersect& isect) const {
+    double pdf = 1.0;
+    const Spectrum kd = RGB2Spectrum(isect.mtlPtr->Kd, 0);
+    const Spectrum fs = bsdf.evaluateSpectrumBSDF(pdf, kd);
+    path.throughput = path.throughput * fs.c[path.lambdaIdx] * bsdf.getCosTerm() / pdf;
+}
 
-            // Set next ray and update throughput
-            const double cosTerm = Vec3::absDot(ray.d, isect.normal);
-            BSDF bsdf = BSDF(ray, isect, cosTerm);
-            const Vec3 dir = bsdf.evaluateDirection(rng);
-            double pdf = 1.0;
-            const Spectrum kd = RGB2Spectrum(isect.mtlPtr->Kd, 0);
-            const Spectrum fs = bsdf.evaluateSpectrumBSDF(pdf, kd);
-            ray = Ray(isect.pos, dir);
-            throughput = throughput * fs.c[lambdaIdx] * cosTerm / pdf;
+void SpectralTransport::applyBSDF(Path& path, const BSDF& bsdf, const Vec3& wi, const double pdf) const {
+    double bsdfPdf;
+    const Spectrum kd = RGB2Spectrum(bsdf.getMaterial()->Kd, 0);
+    const double fs = bsdf.evaluateSpectrumBSDF(wi, bsdfPdf, kd).c[path.lambdaIdx];
+    path.throughput = path.throughput * fs * bsdf.getCosTerm() / pdf;
+}
 
-            // Russian Roulette
-            const double prob = throughput;
-            if (prob == 0) break;
-            if (prob < rng.next() || maxBounce < bounce) {
-                break;
-            }
-            else {
-                throughput = throughput / prob;
-            }
+void SpectralTransport::endPath(Pixel& pixel, const Path& path, Film*, const int) const {
+    pixel.sum.c[path.lambdaIdx] = pixel.sum.c[path.lambdaIdx] + path.radiance;
+    pixel.numLambdaSamples[path.lambdaIdx]++;
+}
 
-            bounce++;
-        }
-        averageSpectrum.c[lambdaIdx] = averageSpectrum.c[lambdaIdx] + spectrum;
-        numLambdaSamples[lambdaIdx]++;
-    }
-    for (int l = 0; l < 60; l++) {
-        if (numLambdaSamples[l] == 0) continue;
-        averageSpectrum.c[l] = averageSpectrum.c[l] * (1.0 / numLambdaSamples[l]);
+void SpectralTransport::endPixel(Pixel& pixel, const int numSamples, Film* film, const int p) const {
+    for (int l = 0; l < numSpectralSamples; l++) {
+        if (pixel.numLambdaSamples[l] == 0) continue;
+        pixel.sum.c[l] = pixel.sum.c[l] * (1.0 / pixel.numLambdaSamples[l]);
     }
-    film->setPixelColor(Spectrum2RGB(averageSpectrum), p);
+    film->addSamples(Spectrum2RGB(pixel.sum) * numSamples, numSamples, p);
 }
 
-void Renderer_SingleSpectrum_PT::initSpectrum() {
+void SpectralTransport::init() {
     // compute XYZ matching functions
     for (int i = 0; i < numSpectralSamples; ++i) {
         double l0 = H_Math::lerp((double)i / (double)numSpectralSamples, sampledLambdaStart, sampledLambdaEnd);
@@ -174,9 +127,12 @@ void Renderer_SingleSpectrum_PT::initSpectrum() {
         rgbIllum2SpectGreen.c[i] = averageSpectrumSamples(RGB2SpectLambda, RGBIllum2SpectGreenData, numRGB2SpectSamples, l0, l1);
         rgbIllum2SpectBlue.c[i] = averageSpectrumSamples(RGB2SpectLambda, RGBIllum2SpectBlueData, numRGB2SpectSamples, l0, l1);
     }
+
+    light.setSpectrum(CIEStandardIlluminantD65);
+    light = Spectrum::map(light, 0.0, 25.0);
 }
 
-Spectrum Renderer_SingleSpectrum_PT::RGB2Spectrum(const Vec3 rgb, int type) {
+Spectrum SpectralTransport::RGB2Spectrum(const Vec3 rgb, int type) const {
     Spectrum answer;
     if (type == 0) { // 0 -> reflectance
         // Convert reflectance spectrum to RGB
@@ -261,7 +217,7 @@ Spectrum Renderer_SingleSpectrum_PT::RGB2Spectrum(const Vec3 rgb, int type) {
     return answer.clamp();
 }
 
-Vec3 Renderer_SingleSpectrum_PT::Spectrum2RGB(const Spectrum& s) {
+Vec3 SpectralTransport::Spectrum2RGB(const Spectrum& s) const {
     // convert Spectrum to XYZ Color
     Vec3 XYZ(0.0, 0.0, 0.0);
     for (int i = 0; i < numSpectralSamples; ++i) {
@@ -280,7 +236,7 @@ Vec3 Renderer_SingleSpectrum_PT::Spectrum2RGB(const Spectrum& s) {
     return Vec3::clamp(RGB);
 }
 
-double Renderer_SingleSpectrum_PT::averageSpectrumSamples(const double* lambda, const double* vals, int n, double lambdaStart, double lambdaEnd) {
+double SpectralTransport::averageSpectrumSamples(const double* lambda, const double* vals, int n, double lambdaStart, double lambdaEnd) {
     if (lambdaEnd <= lambda[0])       return vals[0];
     if (lambda[n - 1] <= lambdaStart) return vals[n - 1];
     if (n == 1) return vals[0];
@@ -299,4 +255,4 @@ double Renderer_SingleSpectrum_PT::averageSpectrumSamples(const double* lambda,
         sum += 0.5 * (interp(segLambdaStart, i) + interp(segLambdaEnd, i)) * (segLambdaEnd - segLambdaStart);
     }
     return sum / (lambdaEnd - lambdaStart);
-}
+}
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+
+namespace hiraishi {
+    class Film;
+    class BSDF;
+    struct Intersect;
+    struct Material;
+    struct Random;
+
+    // Radiance representations for Renderer_Integrator.
+    // A transport holds the state carried along a path, weights emission and BSDF samples,
+    // and writes the paths of a pixel to the film.
+
+    class RGBTransport {
+    public:
+        struct Path {
+            Vec3 radiance;
+            Vec3 throughput;
+        };
+        struct Pixel {};
+
+        static const int minPassSpp = 1;
+        static const bool canAdapt = true;
+        static const bool canEstimateError = true;
+        // radiance can be stored in the scene and added back to paths (caustic photons, irradiance cache)
+        static const bool canStoreRadiance = true;
+
+        void init() {}
+        void beginPixel(Pixel&) const {}
+        void beginPath(Path& path, Random&) const {
+            path.radiance = Vec3(0.0, 0.0, 0.0);
+            path.throughput = Vec3(1.0, 1.0, 1.0);
+        }
+        void addEmission(Path& path, const Material* mtl, const double weight) const;
+        void addRadiance(Path& path, const Vec3& radiance) const { path.radiance = path.radiance + path.throughput * radiance; }
+        Vec3 getRadiance(const Path& path) const { return path.radiance; }
+        // light arriving from direction wi, scale is the geometry term over the light pdf
+        void addDirect(Path& path, const Material* emitter, const BSDF& bsdf, const Vec3& wi, const double scale) const;
+        void applyBSDF(Path& path, const BSDF& bsdf, const Intersect& isect) const;
+        // direction wi sampled with pdf by some other strategy
+        void applyBSDF(Path& path, const BSDF& bsdf, const Vec3& wi, const double pdf) const;
+        void multiplyThroughput(Path& path, const double s) const { path.throughput = path.throughput * s; }
+        void divideThroughput(Path& path, const double s) const { path.throughput = path.throughput / s; }
+        double maxThroughput(const Path& path) const { return fmax(path.throughput.x, fmax(path.throughput.y, path.throughput.z)); }
+        // mean radiance the path has gathered since it was atVertex, through the direction left there
+        double getIncidentRadiance(const Path& path, const Path& atVertex) const;
+        void endPath(Pixel& pixel, const Path& path, Film* film, const int p) const;
+        void endPixel(Pixel& pixel, const int numSamples, Film* film, const int p) const;
+    };
+
+    // one wavelength bin per path, the bins of a pixel are averaged before conversion to RGB
+    class SpectralTransport {
+    private:
+        Spectrum X, Y, Z;
+        Spectrum rgbRefl2SpectWhite,
+            rgbRefl2SpectCyan,
+            rgbRefl2SpectMagenta,
+            rgbRefl2SpectYellow,
+            rgbRefl2SpectRed,
+            rgbRefl2SpectGreen,
+            rgbRefl2SpectBlue;
+        Spectrum rgbIllum2SpectWhite,
+            rgbIllum2SpectCyan,
+            rgbIllum2SpectMagenta,
+            rgbIllum2SpectYellow,
+            rgbIllum2SpectRed,
+            rgbIllum2SpectGreen,
+            rgbIllum2SpectBlue;
+
+        Spectrum light;
+
+        Spectrum RGB2Spectrum(const Vec3 rgb, int type) const;
+        Vec3 Spectrum2RGB(const Spectrum& s) const;
+        static double averageSpectrumSamples(const double* lambda, const double* vals, int n, double lambdaStart, double lambdaEnd);
+
+    public:
+        struct Path {
+            double radiance;
+            double throughput;
+            int lambdaIdx;
+        };
+        struct Pixel {
+            Spectrum sum;
+            int numLambdaSamples[numSpectralSamples];
+        };
+
+        // every wavelength bin has to be sampled in a pass for the per bin average,
+        // which also leaves no per sample value for adaptive sampling or the error estimate
+        static const int minPassSpp = numSpectralSamples;
+        static const bool canAdapt = false;
+        static const bool canEstimateError = false;
+        // the lights emit one illuminant spectrum rather than Ke, radiance stored as RGB would not match them
+        static const bool canStoreRadiance = false;
+
+        void init();
+        void beginPixel(Pixel& pixel) const;
+        void beginPath(Path& path, Random& rng) const;
+        void addEmission(Path& path, const Material*, const double weight) const { path.radiance = path.radiance + light.c[path.lambdaIdx] * path.throughput * weight; }
+        void addRadiance(Path&, const Vec3&) const {}
+        Vec3 getRadiance(const Path&) const { return Vec3(); }
+        void addDirect(Path& path, const Material* emitter, const BSDF& bsdf, const Vec3& wi, const double scale) const;
+        void applyBSDF(Path& path, const BSDF& bsdf, const Intersect& isect) const;
+        void applyBSDF(Path& path, const BSDF& bsdf, const Vec3& wi, const double pdf) const;
+        void multiplyThroughput(Path& path, const double s) const { path.throughput = path.throughput * s; }
+        void divideThroughput(Path& path, const double s) const { path.throughput = path.throughput / s; }
+        double maxThroughput(const Path& path) const { return path.throughput; }
+        double getIncidentRadiance(const Path& path, const Path& atVertex) const {
+            return (0.0 < atVertex.throughput) ? (path.radiance - atVertex.radiance) / atVertex.throughput : 0.0;
+        }
+        void endPath(Pixel& pixel, const Path& path, Film* film, const int p) const;
+        void endPixel(Pixel& pixel, const int numSamples, Film* film, const int p) const;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+namespace hiraishi {
+    // Weighted reservoir of one light sample for resampled direct lighting. Candidates are
+    // streamed through it with weights target / source pdf and one of them is kept with
+    // probability proportional to its weight, reservoirs of other pixels and passes are merged
+    // as if their candidates had been streamed too. [Talbot et al., 2005] [Bitterli et al., 2020]
+    struct Reservoir {
+        LightSample sample;
+        double target = 0.0;        // unshadowed contribution of sample at pos, the target pdf up to scale
+        double weightSum = 0.0;
+        double numCandidates = 0.0; // M
+        double W = 0.0;             // weightSum / (M target), the inverse pdf sample is used with
+        // shading point the reservoir was made for, a neighbour only reuses it where it is alike,
+        // on another material (a black emitter) the sample could have had no target at all
+        Vec3 pos;
+        Vec3 normal;
+        const Material* mtlPtr = NULL;
+
+        void update(const LightSample& candidate, const double candidateTarget, const double weight, const double u) {
+            weightSum += weight;
+            numCandidates += 1.0;
+            if (0.0 < weight && u * weightSum < weight) {
+                sample = candidate;
+                target = candidateTarget;
+            }
+        }
+        // other, whose sample has targetHere at pos, as the numCandidates it was made of
+        void merge(const Reservoir& other, const double targetHere, const double u) {
+            update(other.sample, targetHere, targetHere * other.W * other.numCandidates, u);
+            numCandidates += other.numCandidates - 1.0;
+        }
+        // numSupporting : candidates made at shading points that could have drawn sample, dividing by
+        // all of them would darken where a neighbour sees lights this one does not
+        void finish(const double numSupporting) { W = (0.0 < target && 0.0 < numSupporting) ? weightSum / (numSupporting * target) : 0.0; }
+    };
+}
\ No newline at end of file
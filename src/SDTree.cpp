@@ -0,0 +1,234 @@
+#include <math.h>
+#include "Constant.h"
+#include "Vec3.h"
+#include "Materials/Material.h"
+#include "Ray.h"
+#include "BBox.h"
+#include "SDTree.h"
+
+using namespace hiraishi;
+
+static const int MAX_DTREE_DEPTH = 20;
+static const double DTREE_THRESHOLD = 0.01; // of the radiance in a quadrant to split it
+static const double STREE_THRESHOLD = 12000.0; // records in a leaf to split it, at 4 spp
+
+static void addAtomic(std::atomic<float>& a, const float value) {
+    float current = a.load(std::memory_order_relaxed);
+    while (!a.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {}
+}
+
+static void toSquare(const Vec3& dir, double& x, double& y) {
+    const double cosTheta = fmin(fmax(dir.z, -1.0), 1.0);
+    double phi = atan2(dir.y, dir.x);
+    if (phi < 0.0) phi += 2.0 * M_PI;
+    x = fmin((cosTheta + 1.0) * 0.5, 1.0 - 1e-9);
+    y = fmin(phi / (2.0 * M_PI), 1.0 - 1e-9);
+}
+
+static Vec3 toDirection(const double x, const double y) {
+    const double cosTheta = 2.0 * x - 1.0;
+    const double sinTheta = sqrt(fmax(0.0, 1.0 - cosTheta * cosTheta));
+    const double phi = 2.0 * M_PI * y;
+    return Vec3(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
+}
+
+DTree::Node::Node() {
+    for (int i = 0; i < 4; i++) {
+        sums[i].store(0.0f, std::memory_order_relaxed);
+        children[i] = 0;
+    }
+}
+
+DTree::Node::Node(const Node& node) {
+    *this = node;
+}
+
+DTree::Node& DTree::Node::operator=(const Node& node) {
+    for (int i = 0; i < 4; i++) {
+        sums[i].store(node.getSum(i), std::memory_order_relaxed);
+        children[i] = node.children[i];
+    }
+    return *this;
+}
+
+void DTree::record(const Vec3& dir, const float radiance) {
+    double x, y;
+    toSquare(dir, x, y);
+    int n = 0;
+    while (true) {
+        const int qx = 0.5 <= x, qy = 0.5 <= y;
+        const int q = qx + 2 * qy;
+        addAtomic(nodes[n].sums[q], radiance);
+        if (nodes[n].children[q] == 0) return;
+        n = nodes[n].children[q];
+        x = 2.0 * x - qx;
+        y = 2.0 * y - qy;
+    }
+}
+
+Vec3 DTree::sample(double u1, double u2) const {
+    double x0 = 0.0, y0 = 0.0, size = 1.0;
+    int n = 0;
+    while (true) {
+        const Node& node = nodes[n];
+        double pLeft = 0.5, pBelowLeft = 0.5, pBelowRight = 0.5;
+        const double total = node.getTotal();
+        if (0.0 < total) {
+            const double left = node.getSum(0) + node.getSum(2);
+            const double right = node.getSum(1) + node.getSum(3);
+            pLeft = left / total;
+            if (0.0 < left) pBelowLeft = node.getSum(0) / left;
+            if (0.0 < right) pBelowRight = node.getSum(1) / right;
+        }
+        // the column by u1, then the row in it by u2, the rest of each picks inside the quadrant
+        int qx, qy;
+        if (u1 < pLeft) {
+            qx = 0;
+            u1 = u1 / pLeft;
+        }
+        else {
+            qx = 1;
+            u1 = (u1 - pLeft) / (1.0 - pLeft);
+        }
+        const double pBelow = qx ? pBelowRight : pBelowLeft;
+        if (u2 < pBelow) {
+            qy = 0;
+            u2 = u2 / pBelow;
+        }
+        else {
+            qy = 1;
+            u2 = (u2 - pBelow) / (1.0 - pBelow);
+        }
+        u1 = fmin(u1, 1.0 - 1e-9);
+        u2 = fmin(u2, 1.0 - 1e-9);
+
+        size *= 0.5;
+        x0 += qx * size;
+        y0 += qy * size;
+        const int child = node.children[qx + 2 * qy];
+        if (child == 0) return toDirection(x0 + u1 * size, y0 + u2 * size);
+        n = child;
+    }
+}
+
+double DTree::getPdf(const Vec3& dir) const {
+    double x, y;
+    toSquare(dir, x, y);
+    double pdf = 1.0;
+    int n = 0;
+    while (true) {
+        const Node& node = nodes[n];
+        const int qx = 0.5 <= x, qy = 0.5 <= y;
+        const int q = qx + 2 * qy;
+        const double total = node.getTotal();
+        if (0.0 < total) pdf *= 4.0 * node.getSum(q) / total;
+        if (pdf == 0.0 || node.children[q] == 0) break;
+        n = node.children[q];
+        x = 2.0 * x - qx;
+        y = 2.0 * y - qy;
+    }
+    // the square maps to the sphere with a constant jacobian
+    return pdf / (4.0 * M_PI);
+}
+
+void DTree::refine(const DTree& previous, const int maxDepth, const double threshold) {
+    nodes.assign(1, Node());
+    const double total = previous.getTotal();
+    if (!(0.0 < total)) return;
+
+    struct Entry {
+        int node;
+        int previousNode; // -1 : not split before, the radiance is taken as even
+        double sum;
+        int depth;
+    };
+    std::vector<Entry> stack;
+    stack.push_back({ 0, 0, total, 1 });
+    while (!stack.empty()) {
+        const Entry e = stack.back();
+        stack.pop_back();
+        for (int q = 0; q < 4; q++) {
+            const double sum = (0 <= e.previousNode) ? previous.nodes[e.previousNode].getSum(q) : e.sum * 0.25;
+            if (maxDepth <= e.depth || sum <= threshold * total) continue;
+            const int child = (int)nodes.size();
+            nodes.push_back(Node());
+            nodes[e.node].children[q] = child;
+            const int previousChild = (0 <= e.previousNode) ? previous.nodes[e.previousNode].children[q] : 0;
+            stack.push_back({ child, (previousChild != 0) ? previousChild : -1, sum, e.depth + 1 });
+        }
+    }
+}
+
+void SDTree::init(const BBox& bbox_) {
+    bbox = bbox_;
+    nodes.assign(1, Node());
+    nodes[0].leaf = 0;
+    leaves.clear();
+    leaves.push_back(Leaf());
+    isTrained = false;
+}
+
+int SDTree::findLeaf(const Vec3& pos) const {
+    const Vec3 extent = bbox.max - bbox.min;
+    double p[3] = {
+        (0.0 < extent.x) ? (pos.x - bbox.min.x) / extent.x : 0.0,
+        (0.0 < extent.y) ? (pos.y - bbox.min.y) / extent.y : 0.0,
+        (0.0 < extent.z) ? (pos.z - bbox.min.z) / extent.z : 0.0
+    };
+    int n = 0;
+    while (nodes[n].leaf < 0) {
+        const int axis = nodes[n].axis;
+        const double v = fmin(fmax(p[axis], 0.0), 1.0);
+        const int side = 0.5 <= v;
+        p[axis] = 2.0 * v - side;
+        n = nodes[n].children[side];
+    }
+    return nodes[n].leaf;
+}
+
+void SDTree::record(const Vec3& pos, const Vec3& dir, const double radiance) {
+    Leaf& leaf = leaves[findLeaf(pos)];
+    leaf.numRecords.fetch_add(1, std::memory_order_relaxed);
+    if (0.0 < radiance && radiance < H_INFINITE) leaf.building.record(dir, (float)radiance);
+}
+
+Vec3 SDTree::sample(const Vec3& pos, const Vec3& normal, const double u1, const double u2) const {
+    const Vec3 dir = leaves[findLeaf(pos)].sampling.sample(u1, u2);
+    const double cosTheta = Vec3::dot(dir, normal);
+    return (cosTheta < 0.0) ? dir - normal * (2.0 * cosTheta) : dir;
+}
+
+double SDTree::getPdf(const Vec3& pos, const Vec3& normal, const Vec3& dir) const {
+    const double cosTheta = Vec3::dot(dir, normal);
+    if (cosTheta <= 0.0) return 0.0;
+    const DTree& dTree = leaves[findLeaf(pos)].sampling;
+    return dTree.getPdf(dir) + dTree.getPdf(dir - normal * (2.0 * cosTheta));
+}
+
+void SDTree::refine(const double spp) {
+    // split the leaves that saw many paths, both halves start from a copy
+    const double threshold = STREE_THRESHOLD * sqrt(spp / 4.0);
+    for (size_t n = 0; n < nodes.size(); n++) {
+        const int l = nodes[n].leaf;
+        if (l < 0 || leaves[l].numRecords.load() <= threshold) continue;
+        leaves[l].numRecords.store(leaves[l].numRecords.load() / 2);
+        const Leaf half = leaves[l];
+        leaves.push_back(half);
+        for (int side = 0; side < 2; side++) {
+            Node child;
+            child.axis = (nodes[n].axis + 1) % 3;
+            child.leaf = side ? (int)leaves.size() - 1 : l;
+            nodes[n].children[side] = (int)nodes.size();
+            nodes.push_back(child);
+        }
+        nodes[n].leaf = -1;
+    }
+
+    // what was recorded guides the next iteration, which records into a finer tree
+    for (size_t l = 0; l < leaves.size(); l++) {
+        leaves[l].sampling = leaves[l].building;
+        leaves[l].building.refine(leaves[l].sampling, MAX_DTREE_DEPTH, DTREE_THRESHOLD);
+        leaves[l].numRecords.store(0);
+    }
+    isTrained = true;
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+
+namespace hiraishi {
+    // Quadtree over the directions, mapped to the unit square by (cos theta, phi).
+    // Each node holds the radiance recorded in its four quadrants, finer where more arrives.
+    class DTree {
+    private:
+        struct Node {
+            std::atomic<float> sums[4];
+            int children[4]; // 0 : the quadrant is a leaf, the root is never a child
+
+            Node();
+            Node(const Node& node);
+            Node& operator=(const Node& node);
+            float getSum(const int i) const { return sums[i].load(std::memory_order_relaxed); }
+            float getTotal() const { return getSum(0) + getSum(1) + getSum(2) + getSum(3); }
+        };
+
+        std::vector<Node> nodes;
+
+    public:
+        DTree() : nodes(1) {}
+
+        double getTotal() const { return nodes[0].getTotal(); }
+        // can be called from every thread at once
+        void record(const Vec3& dir, const float radiance);
+        // direction in proportion to the recorded radiance, and its solid angle pdf
+        Vec3 sample(double u1, double u2) const;
+        double getPdf(const Vec3& dir) const;
+        // quadrants of previous holding more than threshold of its total are split, the rest
+        // merged, and the sums start from zero
+        void refine(const DTree& previous, const int maxDepth, const double threshold);
+    };
+
+    // Binary tree over the scene box with a DTree per leaf, learnt over the passes of a render.
+    // Paths are guided by the radiance recorded in the previous training iteration while the
+    // current one is recorded. [Muller et al. 2017, Practical Path Guiding]
+    class SDTree {
+    private:
+        struct Node {
+            int axis = 0;
+            int children[2] = { -1, -1 };
+            int leaf = -1;
+        };
+        struct Leaf {
+            DTree sampling;
+            DTree building;
+            std::atomic<int> numRecords;
+
+            Leaf() : numRecords(0) {}
+            Leaf(const Leaf& leaf) : sampling(leaf.sampling), building(leaf.building), numRecords(leaf.numRecords.load()) {}
+        };
+
+        BBox bbox;
+        std::vector<Node> nodes;
+        std::vector<Leaf> leaves;
+        bool isTrained = false;
+
+        int findLeaf(const Vec3& pos) const;
+
+    public:
+        void init(const BBox& bbox);
+
+        // sample() and getPdf() need one refine() first
+        bool canSample() const { return isTrained; }
+        // radiance over the pdf of the direction the path left pos, thread safe
+        void record(const Vec3& pos, const Vec3& dir, const double radiance);
+        // directions below the surface of normal are mirrored above it, so none are wasted
+        Vec3 sample(const Vec3& pos, const Vec3& normal, const double u1, const double u2) const;
+        double getPdf(const Vec3& pos, const Vec3& normal, const Vec3& dir) const;
+        // ends a training iteration of spp samples per pixel, no other call may run meanwhile
+        void refine(const double spp);
+        size_t getNumLeaves() const { return leaves.size(); }
+    };
+}
\ No newline at end of file
@@ -11,6 +11,7 @@ namespace hiraishi {
 
     public:
         Sampler() {}
+        Sampler(const int startIndex) : index(startIndex) {} // continue the sequence of a progressive pixel
         ~Sampler() {}
 
         static Vec3 uniformSampleTriangle(const Vec3* v, double r1, double r2);
@@ -1,3 +1,6 @@
+#include <iostream>
+#include <string>
+#include <chrono>
 #include "Vec3.h"
 #include "Sampler.h"
 #include "Materials/Material.h"
@@ -8,17 +11,50 @@
 #include "Intersect.h"
 #include "Accelerator/KdTree.h"
 #include "ModelSet.h"
+#include "SceneFile.h"
 #include "Scene.h"
 
 using namespace hiraishi;
 
 void Scene::init(const int w, const int h) {
-    model.readMtl(mtlPath.c_str());
-    model.readObj(objPath.c_str());
-    model.makeFaceEquations();
-    model.initKdTree();
+    const auto start = std::chrono::system_clock::now();
+    std::cout << ">> Load : START" << std::endl;
+    if (isSceneFileUpToDate() && model.readSceneFile(binPath.c_str())) {
+        std::cout << ">> SceneFile : Mapped " << binPath << std::endl;
+        if (!model.hasKdTree()) model.initKdTree();
+    }
+    else {
+        model.readMtl(mtlPath.c_str());
+        model.readObj(objPath.c_str()); // also makes the face equations and the kd-tree while reading
+        if (weld) model.weldVertices();
+        if (binPath != "") model.writeSceneFile(binPath.c_str(), objPath.c_str(), mtlPath.c_str(), weld);
+    }
     model.initVColor();
-    // model.initLightArea(); // currently cannot use
+    if (isCompressed) {
+        if (isFloatTraversal) std::cout << ">> Load : Float traversal is not used with compressed geometry" << std::endl;
+        model.compressGeometry(100000);
+    }
+    else if (isFloatTraversal) {
+        model.initFloatTraversal();
+        model.checkFloatPrecision(100000);
+    }
+    model.initLights(isLightTree);
+    const auto end = std::chrono::system_clock::now();
+    const auto msec = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    std::cout << ">> Load : FINISH" << std::endl
+        << ">> Load : Time " << msec << "msec" << std::endl << std::endl;
+}
+
+bool Scene::isSceneFileUpToDate() const {
+    // the container is a cache of the .obj/.mtl, re-export unless it was made from the same files,
+    // of the same size and time, with the same weld, the header is read before anything is mapped
+    SceneFile::Header header;
+    if (binPath == "" || !SceneFile::readHeader(binPath.c_str(), header)) return false;
+    if (!header.source.matches(SceneFile::makeSource(objPath.c_str(), mtlPath.c_str(), weld))) {
+        std::cout << ">> SceneFile : " << binPath << " was made from other .obj/.mtl or weld, re-export" << std::endl;
+        return false;
+    }
+    return true;
 }
 
 Intersect Scene::intersect(const Ray& ray, Random& rng) const {
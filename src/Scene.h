@@ -5,13 +5,20 @@ namespace hiraishi {
     private:
         ModelSet model;
 
+        bool isSceneFileUpToDate() const;
+
     public:
         Scene() {}
         ~Scene() {}
 
         std::string objPath;
         std::string mtlPath;
+        std::string binPath; // SceneFile, mapped if up to date, otherwise exported after loading .obj
         double scale = 1.0;
+        bool weld = false; // merge vertices sharing a position after loading .obj
+        bool isFloatTraversal = false; // traverse single precision copies, hits are refined in double
+        bool isCompressed = false; // keep 16 bit positions and octahedral normals instead of the loaded geometry
+        bool isLightTree = false; // pick lights by their importance for the shading point instead of by power
 
         void setModel(const ModelSet& modelset) { model = modelset; }
         const ModelSet& getModel() const { return model; }
@@ -0,0 +1,204 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include <sys/stat.h>
+#include "Vec3.h"
+#include "Materials/Material.h"
+#include "Ray.h"
+#include "BBox.h"
+#include "Face.h"
+#include "Intersect.h"
+#include "Accelerator/KdTree.h"
+#include "ModelSet.h"
+#include "SceneFile.h"
+
+using namespace hiraishi;
+
+static const char sceneFileMagic[8] = { 'H', 'R', 'S', 'C', 'E', 'N', 'E', '\0' };
+
+bool SceneFile::open(const char* filename) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(file);
+        return false;
+    }
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    fileSize = (size_t)size.QuadPart;
+#else
+    const int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat statBuf;
+    fstat(fd, &statBuf);
+    void* view = mmap(NULL, statBuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) return false;
+    fileSize = (size_t)statBuf.st_size;
+#endif
+    data = (const char*)view;
+
+    // validate header, sections are trusted after this
+    bool isValid = sizeof(Header) <= fileSize;
+    if (isValid) {
+        const Header& h = getHeader();
+        isValid = memcmp(h.magic, sceneFileMagic, sizeof(sceneFileMagic)) == 0
+            && h.version == version
+            && h.sizeofVec3 == sizeof(Vec3)
+            && h.sizeofFace == sizeof(Face)
+            && h.sizeofNode == sizeof(Node)
+            && h.sizeofMaterial == sizeof(MaterialRecord)
+            && h.numSections == NUM_SECTIONS;
+        for (int i = 0; isValid && i < NUM_SECTIONS; i++) {
+            isValid = h.sections[i].offset + h.sections[i].size <= fileSize;
+        }
+    }
+    if (!isValid) {
+        std::cout << ">> SceneFile : " << filename << " is not compatible with this build" << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool SceneFile::readHeader(const char* filename, Header& header) {
+    FILE* fp;
+    if (fopen_s(&fp, filename, "rb") != 0 || fp == NULL) return false;
+    const bool isRead = fread(&header, sizeof(header), 1, fp) == 1;
+    fclose(fp);
+    if (!isRead || memcmp(header.magic, sceneFileMagic, sizeof(sceneFileMagic)) != 0 || header.version != version) {
+        std::cout << ">> SceneFile : " << filename << " is not compatible with this build" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+SceneFile::Source SceneFile::makeSource(const char* objPath, const char* mtlPath, const bool weld) {
+    Source source;
+    memset(&source, 0, sizeof(source));
+    strncpy_s(source.objPath, objPath, sizeof(source.objPath) - 1);
+    strncpy_s(source.mtlPath, mtlPath, sizeof(source.mtlPath) - 1);
+    struct stat statBuf;
+    if (stat(objPath, &statBuf) == 0) {
+        source.objSize = (uint64_t)statBuf.st_size;
+        source.objTime = (int64_t)statBuf.st_mtime;
+    }
+    if (stat(mtlPath, &statBuf) == 0) {
+        source.mtlSize = (uint64_t)statBuf.st_size;
+        source.mtlTime = (int64_t)statBuf.st_mtime;
+    }
+    source.weld = weld ? 1 : 0;
+    return source;
+}
+
+void SceneFile::close() {
+    if (data == NULL) return;
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle((HANDLE)mappingHandle);
+    CloseHandle((HANDLE)fileHandle);
+    mappingHandle = NULL;
+    fileHandle = NULL;
+#else
+    munmap((void*)data, fileSize);
+#endif
+    data = NULL;
+    fileSize = 0;
+}
+
+bool SceneFile::write(const char* filename, const ModelSet& model, const Source& source, const bool withKdTree) {
+    std::vector<MaterialRecord> materials;
+    for (size_t i = 0; i < model.getMaterials().size(); i++) {
+        materials.push_back(MaterialRecord(model.getMaterials()[i]));
+    }
+
+    const void* sectionData[NUM_SECTIONS];
+    uint64_t sectionSize[NUM_SECTIONS];
+    uint64_t sectionCount[NUM_SECTIONS];
+    sectionData[SECTION_VERTICES] = model.getVertices();
+    sectionCount[SECTION_VERTICES] = model.getNumVertices();
+    sectionSize[SECTION_VERTICES] = model.getNumVertices() * sizeof(Vec3);
+    sectionData[SECTION_VNORMALS] = model.getVNormals();
+    sectionCount[SECTION_VNORMALS] = model.getNumVNormals();
+    sectionSize[SECTION_VNORMALS] = model.getNumVNormals() * sizeof(Vec3);
+    sectionData[SECTION_MATERIALS] = materials.data();
+    sectionCount[SECTION_MATERIALS] = materials.size();
+    sectionSize[SECTION_MATERIALS] = materials.size() * sizeof(MaterialRecord);
+    sectionData[SECTION_FACES] = model.getFaces();
+    sectionCount[SECTION_FACES] = model.getNumFaces();
+    sectionSize[SECTION_FACES] = model.getNumFaces() * sizeof(Face);
+    const size_t numNodes = withKdTree ? model.kdTree.getNumNodes() : 0;
+    const size_t numKdFaces = withKdTree ? model.kdTree.getNumFaceIndices() : 0;
+    sectionData[SECTION_KDNODES] = model.kdTree.getNodes();
+    sectionCount[SECTION_KDNODES] = numNodes;
+    sectionSize[SECTION_KDNODES] = numNodes * sizeof(Node);
+    sectionData[SECTION_KDFACES] = model.kdTree.getFaceIndices();
+    sectionCount[SECTION_KDFACES] = numKdFaces;
+    sectionSize[SECTION_KDFACES] = numKdFaces * sizeof(int);
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, sceneFileMagic, sizeof(sceneFileMagic));
+    header.version = version;
+    header.sizeofVec3 = sizeof(Vec3);
+    header.sizeofFace = sizeof(Face);
+    header.sizeofNode = sizeof(Node);
+    header.sizeofMaterial = sizeof(MaterialRecord);
+    header.numSections = NUM_SECTIONS;
+    header.source = source;
+    uint64_t offset = sectionAlignment;
+    for (int i = 0; i < NUM_SECTIONS; i++) {
+        header.sections[i].offset = offset;
+        header.sections[i].size = sectionSize[i];
+        header.sections[i].count = sectionCount[i];
+        offset += (sectionSize[i] + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+    }
+
+    FILE* fp;
+    if (fopen_s(&fp, filename, "wb") != 0) {
+        std::cout << ">> SceneFile : Cannot write " << filename << std::endl;
+        return false;
+    }
+    const std::vector<char> padding(sectionAlignment, 0);
+    bool isWritten = fwrite(&header, sizeof(header), 1, fp) == 1;
+    isWritten = isWritten && fwrite(padding.data(), 1, sectionAlignment - sizeof(header), fp) == sectionAlignment - sizeof(header);
+    for (int i = 0; isWritten && i < NUM_SECTIONS; i++) {
+        if (sectionSize[i] == 0) continue;
+        isWritten = fwrite(sectionData[i], 1, (size_t)sectionSize[i], fp) == (size_t)sectionSize[i];
+        const size_t pad = (size_t)(header.sections[i].offset + sectionSize[i]) % sectionAlignment;
+        if (isWritten && pad != 0) isWritten = fwrite(padding.data(), 1, sectionAlignment - pad, fp) == sectionAlignment - pad;
+    }
+    // a full disk may only show when the buffer is flushed on close
+    isWritten = fclose(fp) == 0 && isWritten;
+    if (!isWritten) {
+        // a partial file would be rejected by its header at best, so none is left
+        remove(filename);
+        std::cout << ">> SceneFile : Cannot write " << filename << std::endl;
+        return false;
+    }
+
+    std::cout << ">> SceneFile : Export " << filename << std::endl;
+    return true;
+}
\ No newline at end of file
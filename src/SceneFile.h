@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+namespace hiraishi {
+    class ModelSet;
+
+    // Native binary scene container
+    // Sections are page aligned and hold the in-memory layout of this build,
+    // so a mapped file is used in place and pages are only read when touched.
+    class SceneFile {
+    public:
+        enum Section {
+            SECTION_VERTICES = 0,
+            SECTION_VNORMALS,
+            SECTION_MATERIALS,
+            SECTION_FACES,
+            SECTION_KDNODES,
+            SECTION_KDFACES,
+            NUM_SECTIONS
+        };
+
+        struct SectionEntry {
+            uint64_t offset;
+            uint64_t size;  // byte
+            uint64_t count; // element
+        };
+
+        // the .obj/.mtl the container was made from, it is only mapped for the same files and weld
+        struct Source {
+            char objPath[256];
+            char mtlPath[256];
+            uint64_t objSize;
+            int64_t objTime;
+            uint64_t mtlSize;
+            int64_t mtlTime;
+            uint32_t weld;
+
+            bool matches(const Source& s) const {
+                return strncmp(objPath, s.objPath, sizeof(objPath)) == 0 && strncmp(mtlPath, s.mtlPath, sizeof(mtlPath)) == 0
+                    && objSize == s.objSize && objTime == s.objTime && mtlSize == s.mtlSize && mtlTime == s.mtlTime && weld == s.weld;
+            }
+        };
+
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            // layout of this build, a file written by another layout is rejected
+            uint32_t sizeofVec3;
+            uint32_t sizeofFace;
+            uint32_t sizeofNode;
+            uint32_t sizeofMaterial;
+            uint32_t numSections;
+            SectionEntry sections[NUM_SECTIONS];
+            Source source;
+        };
+
+        struct MaterialRecord {
+            char name[64];
+            double Ns;
+            double Ni;
+            double Tr;
+            double d;
+            int illum;
+            Vec3 Ka;
+            Vec3 Kd;
+            Vec3 Ks;
+            Vec3 Ke;
+            Vec3 Tf;
+            double roughness;
+            double anisotopic;
+
+            MaterialRecord() {}
+            MaterialRecord(const Material& m) {
+                memset(name, 0, sizeof(name));
+                const size_t len = m.name.size() < sizeof(name) - 1 ? m.name.size() : sizeof(name) - 1;
+                memcpy(name, m.name.c_str(), len);
+                Ns = m.Ns;
+                Ni = m.Ni;
+                Tr = m.Tr;
+                d = m.d;
+                illum = m.illum;
+                Ka = m.Ka;
+                Kd = m.Kd;
+                Ks = m.Ks;
+                Ke = m.Ke;
+                Tf = m.Tf;
+                roughness = m.roughness;
+                anisotopic = m.anisotopic;
+            }
+            Material toMaterial() const {
+                Material m(name, Ns, Ni, Tr, d, illum, Ka, Kd, Ks, Ke, Tf);
+                m.roughness = roughness;
+                m.anisotopic = anisotopic;
+                return m;
+            }
+        };
+
+        static const uint32_t version = 2;
+        static const uint64_t sectionAlignment = 4096;
+
+    private:
+        const char* data = NULL;
+        size_t fileSize = 0;
+        void* fileHandle = NULL;
+        void* mappingHandle = NULL;
+
+        SceneFile(const SceneFile&);
+        SceneFile& operator=(const SceneFile&);
+
+    public:
+        SceneFile() {}
+        ~SceneFile() { close(); }
+
+        bool open(const char* filename);
+        void close();
+        bool isOpen() const { return data != NULL; }
+        const Header& getHeader() const { return *(const Header*)data; }
+        const void* getSection(const Section s) const { return data + getHeader().sections[s].offset; }
+        size_t getCount(const Section s) const { return (size_t)getHeader().sections[s].count; }
+
+        // the header alone, read without mapping the file to see whether it is still up to date
+        static bool readHeader(const char* filename, Header& header);
+        // sizes and times of the files now, a missing file is 0
+        static Source makeSource(const char* objPath, const char* mtlPath, const bool weld);
+        static bool write(const char* filename, const ModelSet& model, const Source& source, const bool withKdTree);
+    };
+}
\ No newline at end of file
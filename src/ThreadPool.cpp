@@ -0,0 +1,55 @@
+#include "ThreadPool.h"
+
+using namespace hiraishi;
+
+ThreadPool::ThreadPool(int numThreads) {
+    if (numThreads <= 0) numThreads = (int)std::thread::hardware_concurrency();
+    if (numThreads <= 0) numThreads = 1;
+    for (int i = 0; i < numThreads; i++) {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        isStopping = true;
+    }
+    taskCv.notify_all();
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+void ThreadPool::push(const std::function<void()>& task) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        tasks.push_back(task);
+    }
+    taskCv.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mtx);
+    doneCv.wait(lock, [this]() { return tasks.empty() && numActive == 0; });
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            taskCv.wait(lock, [this]() { return isStopping || !tasks.empty(); });
+            if (isStopping && tasks.empty()) return;
+            task = tasks.front();
+            tasks.pop_front();
+            numActive++;
+        }
+        task();
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            numActive--;
+        }
+        doneCv.notify_all();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace hiraishi {
+    class ThreadPool {
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mtx;
+        std::condition_variable taskCv;
+        std::condition_variable doneCv;
+        int numActive = 0;
+        bool isStopping = false;
+
+        void workerLoop();
+
+    public:
+        ThreadPool(int numThreads = 0); // 0 : number of hardware threads
+        ~ThreadPool();
+
+        int getNumThreads() const { return (int)workers.size(); }
+
+        void push(const std::function<void()>& task);
+        void wait();
+    };
+}
\ No newline at end of file
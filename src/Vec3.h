@@ -235,5 +235,41 @@ namespace hiraishi {
             const Vec3 v(b, s + n.y * n.y * a, -n.y);
             return (u * ans.x + n * ans.y + v * ans.z).normalize();
         }
+
+        // inverse of convertVectorRelativeToN, n is the y axis of the result
+        inline static Vec3 convertVectorToLocalOfN(const Vec3& w, const Vec3& n) {
+            const double s = copysign(1.0, n.z);
+            const double a = -1.0 / (s + n.z);
+            const double b = n.x * n.y * a;
+            const Vec3 u(1.0 + s * n.x * n.x * a, s * b, -s * n.x);
+            const Vec3 v(b, s + n.y * n.y * a, -n.y);
+            return Vec3(dot(w, u), dot(w, n), dot(w, v));
+        }
+    };
+
+    // single precision storage for traversal, arithmetic is kept to what the triangle test needs
+    struct Vec3f {
+        float x, y, z;
+
+        Vec3f() : x(0), y(0), z(0) {}
+        Vec3f(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+        explicit Vec3f(const Vec3& v) : x((float)v.x), y((float)v.y), z((float)v.z) {}
+
+        inline Vec3f operator+(const Vec3f& v) const { return Vec3f(x + v.x, y + v.y, z + v.z); }
+        inline Vec3f operator-(const Vec3f& v) const { return Vec3f(x - v.x, y - v.y, z - v.z); }
+        inline Vec3f operator*(const float f) const { return Vec3f(x * f, y * f, z * f); }
+        inline Vec3f operator-() const { return Vec3f(-x, -y, -z); }
+
+        inline static float dot(const Vec3f& v0, const Vec3f& v1) {
+            return v0.x * v1.x + v0.y * v1.y + v0.z * v1.z;
+        }
+
+        inline static Vec3f cross(const Vec3f& v0, const Vec3f& v1) {
+            return Vec3f(v0.y * v1.z - v0.z * v1.y,
+                         v0.z * v1.x - v0.x * v1.z,
+                         v0.x * v1.y - v0.y * v1.x);
+        }
+
+        inline Vec3 toVec3() const { return Vec3(x, y, z); }
     };
 }
\ No newline at end of file
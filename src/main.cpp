@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include <ctype.h>
+#include <thread>
 #include <GL/glut.h>
 #include "Vec3.h"
 #include "Spectrum.h"
@@ -16,13 +17,19 @@
 #include "Intersect.h"
 #include "Accelerator/KdTree.h"
 #include "ModelSet.h"
+#include "Reservoir.h"
+#include "SDTree.h"
+#include "PhotonMap.h"
+#include "IrradianceCache.h"
+#include "SceneFile.h"
 #include "Film.h"
 #include "Scene.h"
+#include "BatchJob.h"
 #include "Renderer/Renderer.h"
-#include "Renderer/Renderer_PT.h"
-#include "Renderer/Renderer_NEE.h"
-#include "Renderer/Renderer_SingleSpectrum_PT.h"
-#include "Renderer/Renderer_PT_Volume.h"
+#include "Renderer/Transport.h"
+#include "Renderer/Integrator.h"
+#include "Renderer/Renderer_Wavefront.h"
+#include "Renderer/Renderer_BDPT.h"
 #include "Renderer/Renderer_OpenGL.h"
 #include "Denoiser/Filter.h"
 #include "Denoiser/Denoiser.h"
@@ -37,8 +44,10 @@ Renderer_OpenGL GLRenderer;
 Film film;
 Map map;
 Denoiser denoiser;
+BatchJob batch;
 
 bool isGLDraw = true;
+std::thread renderThread; // renders in the background so the window shows the film while passes are added
 
 void printHelp() {
     std::cout
@@ -49,7 +58,10 @@ void printHelp() {
         << "Key Config"                         << std::endl
         << std::endl
         << "[ R ] : Start Rendering"            << std::endl
+        << "[ C ] : Continue Rendering"         << std::endl
+        << "[ X ] : Stop Rendering"             << std::endl
         << "[ O ] : Output Rendered Image"      << std::endl
+        << "[ B ] : Batch Rendering"            << std::endl
         << "[ Q ] : Toggle OpenGL"              << std::endl
         << std::endl
         << "[ W ] : Camera : Move Z-"           << std::endl
@@ -60,6 +72,7 @@ void printHelp() {
         << "[ TAB ] : Camera : Move Y-"         << std::endl
         << std::endl
         << "Note : DO NOT start rendering before FINISH to generate Kd-Tree." << std::endl
+        << "Note : \"hiraishi batch\" renders the frames of Batch.turntable or Batch.cameras without a window." << std::endl
         << std::endl
         << "------------------------------"     << std::endl
         << std::endl;
@@ -76,14 +89,43 @@ void initialReadPreferences(const char *filename) {
         if (words.size() == 0 || words[0] == "#") continue;
         if (words[0] == "Renderer.spp") renderer.spp = atoi(words[1].c_str());
         if (words[0] == "Renderer.maxBounce") renderer.maxBounce = atoi(words[1].c_str());
+        if (words[0] == "Renderer.tileSize") renderer.tileSize = atoi(words[1].c_str());
+        if (words[0] == "Renderer.passSpp") renderer.passSpp = atoi(words[1].c_str());
+        if (words[0] == "Renderer.multiResolution") renderer.isMultiResolution = atoi(words[1].c_str()) != 0;
+        if (words[0] == "Renderer.sobol") renderer.isSobol = atoi(words[1].c_str()) != 0;
+        if (words[0] == "Renderer.blueNoise") renderer.isBlueNoise = atoi(words[1].c_str()) != 0;
+        if (words[0] == "Renderer.guiding") renderer.isGuiding = atoi(words[1].c_str()) != 0;
+        if (words[0] == "Renderer.causticPhotons") renderer.numCausticPhotons = atoi(words[1].c_str());
+        if (words[0] == "Renderer.irradianceCache") renderer.isIrradianceCaching = atoi(words[1].c_str()) != 0;
+        if (words[0] == "Renderer.primaryCache") renderer.primaryCacheSpp = atoi(words[1].c_str());
+        if (words[0] == "Renderer.reservoir") renderer.isReservoirSampling = atoi(words[1].c_str()) != 0;
+        if (words[0] == "Renderer.adaptive") renderer.isAdaptive = atoi(words[1].c_str()) != 0;
+        if (words[0] == "Renderer.baseSpp") renderer.baseSpp = atoi(words[1].c_str());
+        if (words[0] == "Renderer.targetError") renderer.targetError = atof(words[1].c_str());
+        if (words[0] == "Renderer.timeBudget") renderer.timeBudget = atof(words[1].c_str());
+        if (words[0] == "Renderer.errorTarget") renderer.isErrorTarget = atoi(words[1].c_str()) != 0;
         if (words[0] == "Film.width") film.width = atoi(words[1].c_str());
         if (words[0] == "Film.height") film.height = atoi(words[1].c_str());
+        if (words[0] == "Film.crop") {
+            film.cropX = atoi(words[1].c_str());
+            film.cropY = atoi(words[2].c_str());
+            film.cropWidth = atoi(words[3].c_str());
+            film.cropHeight = atoi(words[4].c_str());
+        }
         if (words[0] == "Scene.obj") scene.objPath = words[1];
         if (words[0] == "Scene.mtl") scene.mtlPath = words[1];
+        if (words[0] == "Scene.bin") scene.binPath = words[1];
         if (words[0] == "Scene.scale") scene.scale = atof(words[1].c_str());
+        if (words[0] == "Scene.weld") scene.weld = atoi(words[1].c_str()) != 0;
+        if (words[0] == "Scene.precision") scene.isFloatTraversal = words[1] == "float";
+        if (words[0] == "Scene.compress") scene.isCompressed = atoi(words[1].c_str()) != 0;
+        if (words[0] == "Scene.lightTree") scene.isLightTree = atoi(words[1].c_str()) != 0;
         if (words[0] == "Camera.eye") camera.setEye(Vec3(atof(words[1].c_str()), atof(words[2].c_str()), atof(words[3].c_str())));
         if (words[0] == "Camera.center") camera.setCenter(Vec3(atof(words[1].c_str()), atof(words[2].c_str()), atof(words[3].c_str())));
         if (words[0] == "Camera.fov") camera.setFovDeg(atof(words[1].c_str()));
+        if (words[0] == "Batch.cameras") batch.camerasPath = (1 < words.size()) ? words[1] : "";
+        if (words[0] == "Batch.frames") batch.numPathFrames = atoi(words[1].c_str());
+        if (words[0] == "Batch.turntable") batch.numTurntableFrames = atoi(words[1].c_str());
     }
 
     fclose(fp);
@@ -99,10 +141,19 @@ void readPreferences(const char* filename) {
         std::vector<std::string> words = getWords(str);
         if (words.size() == 0 || words[0] == "#") continue;
         if (words[0] == "Renderer.spp") renderer.spp = atoi(words[1].c_str());
+        if (words[0] == "Film.crop") {
+            film.cropX = atoi(words[1].c_str());
+            film.cropY = atoi(words[2].c_str());
+            film.cropWidth = atoi(words[3].c_str());
+            film.cropHeight = atoi(words[4].c_str());
+        }
         if (words[0] == "Scene.scale") scene.scale = atof(words[1].c_str());
         if (words[0] == "Camera.eye") camera.setEye(Vec3(atof(words[1].c_str()), atof(words[2].c_str()), atof(words[3].c_str())));
         if (words[0] == "Camera.center") camera.setCenter(Vec3(atof(words[1].c_str()), atof(words[2].c_str()), atof(words[3].c_str())));
         if (words[0] == "Camera.fov") camera.setFovDeg(atof(words[1].c_str()));
+        if (words[0] == "Batch.cameras") batch.camerasPath = (1 < words.size()) ? words[1] : "";
+        if (words[0] == "Batch.frames") batch.numPathFrames = atoi(words[1].c_str());
+        if (words[0] == "Batch.turntable") batch.numTurntableFrames = atoi(words[1].c_str());
     }
 
     fclose(fp);
@@ -137,7 +188,27 @@ void reshape(int width, int height) {
     glMatrixMode(GL_MODELVIEW);
 }
 
+void stopRender() {
+    if (!renderThread.joinable()) return;
+    batch.stop();
+    renderer.stop();
+    renderThread.join();
+}
+
+void startRender() {
+    stopRender();
+    renderer.resetStop();
+    renderThread = std::thread([]() { renderer.render(&scene, &camera, &film); });
+}
+
+void renderBatch() {
+    batch.render(&camera, &film, []() { renderer.render(&scene, &camera, &film); });
+}
+
 void keyFunc(unsigned char key, int x, int y) {
+    // the camera and the film are shared with the render threads
+    if (key != 'o' && key != 'O') stopRender();
+
     switch (key) {
     case 'q':
     case 'Q':
@@ -148,12 +219,33 @@ void keyFunc(unsigned char key, int x, int y) {
         isGLDraw = false;
         readPreferences("preferences.txt");
         camera.init(film.width, film.height);
-        renderer.render(&scene, &camera, &film);
+        film.clearAccumulation();
+        startRender();
+        break;
+    case 'c':
+    case 'C':
+        // add spp more samples to the current film
+        isGLDraw = false;
+        startRender();
         break;
+    case 'x':
+    case 'X':
+        break; // already stopped above
     case 'o':
     case 'O':
         film.writeImage();
         break;
+    case 'b':
+    case 'B':
+        // every frame on the scene loaded at startup, the window shows the one rendering
+        isGLDraw = false;
+        readPreferences("preferences.txt");
+        if (batch.initFrames(camera)) {
+            renderer.resetStop();
+            batch.resetStop();
+            renderThread = std::thread(renderBatch);
+        }
+        break;
     case 'w':
     case 'W':
         camera.setEye(camera.getEye() + Vec3(0.0, 0.0, -0.1));
@@ -185,15 +277,20 @@ void refresh() {
     glutPostRedisplay();
 }
 
+void initObjects() {
+    scene.init(film.width, film.height);
+    camera.init(film.width, film.height);
+    film.init();
+    map.init(film.width, film.height, renderer.spp);
+    renderer.auxMap = &map;
+}
+
 void initHiraishi() {
     glEnable(GL_DEPTH_TEST);
     glClearColor(0.7, 0.9, 1.0, 1.0);
 
     // init objects
-    scene.init(film.width, film.height);
-    camera.init(film.width, film.height);
-    film.init();
-    map.init(film.width, film.height, renderer.spp);
+    initObjects();
 }
 
 void main(int argc, char** argv) {
@@ -202,6 +299,13 @@ void main(int argc, char** argv) {
     // read settings
     initialReadPreferences("preferences.txt");
 
+    // batch job, the frames are rendered and written without opening the window
+    if (2 <= argc && std::string(argv[1]) == "batch") {
+        initObjects();
+        if (batch.initFrames(camera)) renderBatch();
+        return;
+    }
+
     // glut
     glutInit(&argc, argv);
     glutInitWindowPosition(100, 100);
@@ -217,6 +321,7 @@ void main(int argc, char** argv) {
 
     // init
     initHiraishi();
+    atexit(stopRender);
 
     //renderer.render(&scene, &camera, &film);
 